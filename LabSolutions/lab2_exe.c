@@ -0,0 +1,532 @@
+
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <dirent.h>
+
+
+//askhsh2 OS se C
+//-----------------------------------------------
+//sort_files [-lr] [-j threads] <extension> <year> <n|o>
+//idio me to sort_files tou lab2_exe.sh: metakinei sto ./output ola ta arxeia *.extension
+//pou einai newer (n) h oxi newer (o) apo to year-01-01, alla xwris ena mv ana arxeio.
+//O katalogos diatrexetai apo threads me koinh oura katalogwn (openat/getdents64),
+//to mtime elegxetai me fstatat kai h metakinhsh ginetai me renameat.
+//
+//Sto ./.sort_files.idx krataei ana katalogo to mtime tou kai ta onomata twn
+//arxeiwn kai ypokatalogwn tou. Se epomeno run enas katalogos me idio mtime
+//den ksanadiavazetai (xwris getdents), ta onomata erxontai apo to index
+//(-l: mono ektypwsh, xwris metakinhsh). To mtime enos arxeiou den krataetai:
+//ena touch den allazei to mtime tou katalogou, ara fstatat ginetai, kai sta
+//dyo monopatia, mono sta onomata pou tairiazoun sto *.extension.
+//To -r agnoei to index kai ta ksanadiavazei ola.
+
+#define WALK_BUFSIZE 65536
+#define IDX_FILE ".sort_files.idx"
+#define IDX_MAGIC "SFIDX02"         //8 bytes mazi me to '\0'
+
+struct linux_dirent64 {
+    unsigned long long d_ino;
+    long long          d_off;
+    unsigned short     d_reclen;
+    unsigned char      d_type;
+    char               d_name[];
+};
+
+//to index: ena idxDir ana katalogo, me ta arxeia kai tous ypokatalogous tou
+typedef struct idxEnt {
+    const char *name;               //NULL: metakinh8hke se auto to run
+    int isDir;
+} idxEnt;
+
+typedef struct idxDir {
+    const char *path;
+    struct timespec mtime;          //tv_nsec -1: den 8ewreitai egkyro
+    int n, cap;
+    idxEnt *ent;
+    struct idxDir *next;
+} idxDir;
+
+//ena stoixeio ths ouras: katalogos pou den exei diavastei akoma
+typedef struct walkDir {
+    char *path;
+    struct walkDir *next;
+} walkDir;
+
+static pthread_mutex_t walkLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t walkCond = PTHREAD_COND_INITIALIZER;
+static walkDir *walkHead = 0;
+static int walkBusy = 0;            //katalogoi sthn oura + autoi pou diavazontai twra
+
+static char walkPattern[PATH_MAX];  //"*.extension" opws to find -name
+static time_t walkCutoff;           //year-01-01 00:00 se topikh wra, opws to -newermt
+static int walkNewer;               //1 gia n, 0 gia o
+static int walkOut = -1;            //fd tou ./output
+static int walkList;                //-l: ektypwsh antu gia metakinhsh
+static atomic_int walkErrors = 0;
+
+static char *idxBuf;                //to palio index olo sth mnhmh
+static idxDir *idxOld, **idxHash;
+static size_t idxOldN, idxHashSize;
+static idxDir *idxNew;              //ti 8a grapsoume, prostithetai me to walkLock
+static struct timespec idxStart;
+
+static size_t idxHashPath(const char *s){
+    size_t h = 1469598103934665603ULL;
+
+    while(*s)
+        h = (h ^ (unsigned char)*s++) * 1099511628211ULL;
+    return h;
+}
+
+static idxDir *idxFind(const char *path){
+    size_t i;
+
+    if(idxHashSize == 0)
+        return NULL;
+    for(i = idxHashPath(path) & (idxHashSize - 1); idxHash[i]; i = (i + 1) & (idxHashSize - 1))
+        if(strcmp(idxHash[i]->path, path) == 0)
+            return idxHash[i];
+    return NULL;
+}
+
+static void idxAdd(idxDir *d, const char *name, int isDir){
+    if(d->n == d->cap){
+        d->cap = d->cap ? 2 * d->cap : 16;
+        if((d->ent = realloc(d->ent, d->cap * sizeof(idxEnt))) == NULL){
+            perror("realloc");
+            exit(1);
+        }
+    }
+    d->ent[d->n].name = name;
+    d->ent[d->n].isDir = isDir;
+    d->n++;
+}
+
+//kanei to d meros tou neou index
+static void idxKeep(idxDir *d){
+    pthread_mutex_lock(&walkLock);
+    d->next = idxNew;
+    idxNew = d;
+    pthread_mutex_unlock(&walkLock);
+}
+
+//diavasma enos pediou apo to arxeio, 0 an teleiwse prowra
+static int idxGet(char **p, char *end, void *dst, size_t len){
+    if((size_t)(end - *p) < len)
+        return 0;
+    memcpy(dst, *p, len);
+    *p += len;
+    return 1;
+}
+
+static const char *idxGetStr(char **p, char *end){
+    char *s = *p, *z = memchr(s, '\0', end - s);
+
+    if(z == NULL)
+        return NULL;
+    *p = z + 1;
+    return s;
+}
+
+static int idxGetTime(char **p, char *end, struct timespec *t){
+    int64_t v[2];
+
+    if(!idxGet(p, end, v, sizeof(v)))
+        return 0;
+    t->tv_sec = v[0];
+    t->tv_nsec = v[1];
+    return 1;
+}
+
+//fortwnei to IDX_FILE, an leipei h einai xalasmeno ola 8a diavastoun apo thn arxh
+static void idxLoad(void){
+    struct stat st;
+    char *p, *end, magic[8];
+    uint64_t nDirs = 0;
+    uint32_t nEnt;
+    unsigned char isDir;
+    idxDir *d;
+    size_t i, j, h;
+    ssize_t r;
+    int fd;
+
+    if((fd = open(IDX_FILE, O_RDONLY | O_CLOEXEC)) < 0)
+        return;
+    if(fstat(fd, &st) < 0 || (idxBuf = malloc(st.st_size + 1)) == NULL){
+        close(fd);
+        return;
+    }
+    for(i = 0; i < (size_t)st.st_size; i += r)
+        if((r = read(fd, idxBuf + i, st.st_size - i)) <= 0)
+            break;
+    close(fd);
+    p = idxBuf;
+    end = idxBuf + i;
+
+    if(!idxGet(&p, end, magic, 8) || memcmp(magic, IDX_MAGIC, 8) != 0 ||
+        !idxGet(&p, end, &nDirs, sizeof(nDirs)) || nDirs > (uint64_t)(end - p))
+        goto bad;
+    if((idxOld = calloc(nDirs ? nDirs : 1, sizeof(idxDir))) == NULL)
+        goto bad;
+    for(idxOldN = 0; idxOldN < nDirs; idxOldN++){
+        d = &idxOld[idxOldN];
+        if((d->path = idxGetStr(&p, end)) == NULL || !idxGetTime(&p, end, &d->mtime) ||
+            !idxGet(&p, end, &nEnt, sizeof(nEnt)))
+            goto bad;
+        for(j = 0; j < nEnt; j++){
+            const char *name;
+
+            if(!idxGet(&p, end, &isDir, 1) || (name = idxGetStr(&p, end)) == NULL)
+                goto bad;
+            idxAdd(d, name, isDir);
+        }
+    }
+
+    for(idxHashSize = 16; idxHashSize < 2 * idxOldN; idxHashSize *= 2)
+        ;
+    if((idxHash = calloc(idxHashSize, sizeof(idxDir *))) == NULL)
+        goto bad;
+    for(i = 0; i < idxOldN; i++){
+        for(h = idxHashPath(idxOld[i].path) & (idxHashSize - 1); idxHash[h]; h = (h + 1) & (idxHashSize - 1))
+            ;
+        idxHash[h] = &idxOld[i];
+    }
+    return;
+
+bad:
+    fprintf(stderr, "%s: invalid index, rescanning\n", IDX_FILE);
+    for(i = 0; idxOld && i <= idxOldN && i < nDirs; i++)
+        free(idxOld[i].ent);
+    free(idxOld);
+    free(idxHash);
+    free(idxBuf);
+    idxOld = NULL;
+    idxHash = NULL;
+    idxBuf = NULL;
+    idxOldN = idxHashSize = 0;
+}
+
+static void idxPutTime(FILE *f, const struct timespec *t){
+    int64_t v[2] = { t->tv_sec, t->tv_nsec };
+
+    fwrite(v, sizeof(v), 1, f);
+}
+
+//grafei to idxNew se proswrino arxeio kai to metonomazei panw sto IDX_FILE
+static void idxSave(void){
+    FILE *f;
+    idxDir *d;
+    uint64_t nDirs = 0;
+    uint32_t nEnt;
+    unsigned char isDir;
+    int i;
+
+    if((f = fopen(IDX_FILE ".tmp", "we")) == NULL){
+        perror(IDX_FILE ".tmp");
+        return;
+    }
+    for(d = idxNew; d; d = d->next)
+        nDirs++;
+    fwrite(IDX_MAGIC, 8, 1, f);
+    fwrite(&nDirs, sizeof(nDirs), 1, f);
+    for(d = idxNew; d; d = d->next){
+        fwrite(d->path, strlen(d->path) + 1, 1, f);
+        idxPutTime(f, &d->mtime);
+        for(nEnt = 0, i = 0; i < d->n; i++)
+            nEnt += d->ent[i].name != NULL;
+        fwrite(&nEnt, sizeof(nEnt), 1, f);
+        for(i = 0; i < d->n; i++){
+            if(d->ent[i].name == NULL)
+                continue;
+            isDir = d->ent[i].isDir;
+            fwrite(&isDir, 1, 1, f);
+            fwrite(d->ent[i].name, strlen(d->ent[i].name) + 1, 1, f);
+        }
+    }
+    if(ferror(f) | fclose(f) || rename(IDX_FILE ".tmp", IDX_FILE) < 0){
+        perror(IDX_FILE);
+        unlink(IDX_FILE ".tmp");
+    }
+}
+
+static void walkPush(const char *parent, const char *name){
+    walkDir *d = malloc(sizeof(walkDir));
+    size_t lp = strlen(parent), ln = strlen(name);
+
+    if(d == NULL || (d->path = malloc(lp + ln + 2)) == NULL){
+        perror("malloc");
+        exit(1);
+    }
+    memcpy(d->path, parent, lp);
+    d->path[lp] = '/';
+    memcpy(d->path + lp + 1, name, ln + 1);
+
+    pthread_mutex_lock(&walkLock);
+    d->next = walkHead;
+    walkHead = d;
+    walkBusy++;
+    pthread_cond_signal(&walkCond);
+    pthread_mutex_unlock(&walkLock);
+}
+
+//find -newermt: mtime austhra megalytero apo to cutoff
+static int walkIsNewer(const struct timespec *t){
+    return t->tv_sec > walkCutoff || (t->tv_sec == walkCutoff && t->tv_nsec > 0);
+}
+
+//arxeio tou katalogou dfd: prwta to onoma (fnmatch), kai mono an tairiazei
+//fstatat gia to mtime. An tairiazei kai auto to metakinei (h to typwnei me
+//-l). Epistrefei 1 an den yparxei pia ekei (na bgei apo to index).
+static int walkFile(int dfd, const char *path, const char *name){
+    struct stat st;
+
+    if(fnmatch(walkPattern, name, 0) != 0)
+        return 0;
+    if(fstatat(dfd, name, &st, AT_SYMLINK_NOFOLLOW) < 0){
+        if(errno == ENOENT)
+            return 1;
+        fprintf(stderr, "stat %s/%s: %s\n", path, name, strerror(errno));
+        return 0;
+    }
+    if(!S_ISREG(st.st_mode))
+        return 1;
+    if(walkIsNewer(&st.st_mtim) != walkNewer)
+        return 0;
+    if(walkList){
+        printf("%s/%s\n", path, name);
+        return 0;
+    }
+    if(renameat(dfd, name, walkOut, name) < 0){
+        if(errno == ENOENT)
+            return 1;
+        fprintf(stderr, "move %s/%s: %s\n", path, name, strerror(errno));
+        atomic_fetch_add(&walkErrors, 1);
+        return 0;
+    }
+    return 1;
+}
+
+//onomata pou den ta agizoume sto ./
+static int walkSkipTop(const char *name){
+    return strcmp(name, "output") == 0 || strcmp(name, IDX_FILE) == 0 ||
+           strcmp(name, IDX_FILE ".tmp") == 0;
+}
+
+//o katalogos den allakse apo to teleutaio run: ta onomata apo to index
+static void walkCached(idxDir *d){
+    int i, dfd = -1, top = strcmp(d->path, ".") == 0;
+
+    for(i = 0; i < d->n; i++){
+        if(top && walkSkipTop(d->ent[i].name)){
+            d->ent[i].name = NULL;
+            continue;
+        }
+        if(d->ent[i].isDir){
+            walkPush(d->path, d->ent[i].name);
+            continue;
+        }
+        if(fnmatch(walkPattern, d->ent[i].name, 0) != 0)
+            continue;
+        if(dfd < 0 && (dfd = openat(AT_FDCWD, d->path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)) < 0){
+            fprintf(stderr, "open %s: %s\n", d->path, strerror(errno));
+            atomic_fetch_add(&walkErrors, 1);
+            break;
+        }
+        if(walkFile(dfd, d->path, d->ent[i].name))
+            d->ent[i].name = NULL;
+    }
+    if(dfd >= 0)
+        close(dfd);
+    idxKeep(d);
+}
+
+static void walkOne(const char *path, char *buf){
+    struct linux_dirent64 *de;
+    struct stat st;
+    idxDir *d = idxFind(path);
+    char *name;
+    long n, off;
+    int dfd, top = strcmp(path, ".") == 0;
+
+    if(d && fstatat(AT_FDCWD, path, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode) &&
+        st.st_mtim.tv_sec == d->mtime.tv_sec && st.st_mtim.tv_nsec == d->mtime.tv_nsec){
+        walkCached(d);
+        return;
+    }
+
+    dfd = openat(AT_FDCWD, path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if(dfd < 0){
+        fprintf(stderr, "open %s: %s\n", path, strerror(errno));
+        atomic_fetch_add(&walkErrors, 1);
+        return;
+    }
+    if((d = calloc(1, sizeof(idxDir))) == NULL || (d->path = strdup(path)) == NULL){
+        perror("malloc");
+        exit(1);
+    }
+    //to mtime pairnetai prin to getdents, ara allagh pou de 8a doume to allazei.
+    //Allagh sto idio tick tou rologiou omws mporei na min to allaksei: opoios
+    //katalogos allakse apo ligo prin to run ksanadiavazetai thn epomenh fora.
+    if(fstat(dfd, &st) == 0 && st.st_mtim.tv_sec < idxStart.tv_sec - 1)
+        d->mtime = st.st_mtim;
+    else
+        d->mtime.tv_nsec = -1;
+
+    while((n = syscall(SYS_getdents64, dfd, buf, WALK_BUFSIZE)) > 0){
+        for(off = 0; off < n; off += de->d_reclen){
+            de = (struct linux_dirent64 *)(buf + off);
+            if(strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+                continue;
+            //to output den to ksanapername, ta arxeia tou einai hdh ekei
+            if(top && walkSkipTop(de->d_name))
+                continue;
+            if(de->d_type == DT_UNKNOWN){
+                if(fstatat(dfd, de->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0)
+                    continue;
+                de->d_type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_LNK;
+            }
+            if(de->d_type != DT_DIR && de->d_type != DT_REG)
+                continue;
+            if(de->d_type == DT_DIR)
+                walkPush(path, de->d_name);
+            else if(walkFile(dfd, path, de->d_name))
+                continue;
+            if((name = strdup(de->d_name)) == NULL){
+                perror("malloc");
+                exit(1);
+            }
+            idxAdd(d, name, de->d_type == DT_DIR);
+        }
+    }
+    if(n < 0){
+        fprintf(stderr, "getdents %s: %s\n", path, strerror(errno));
+        atomic_fetch_add(&walkErrors, 1);
+        d->mtime.tv_nsec = -1;
+    }
+    close(dfd);
+    idxKeep(d);
+}
+
+static void *walkWorker(void *arg){
+    char *buf = malloc(WALK_BUFSIZE);
+    walkDir *d;
+
+    (void)arg;
+    if(buf == NULL){
+        perror("malloc");
+        exit(1);
+    }
+    for(;;){
+        pthread_mutex_lock(&walkLock);
+        while(walkHead == NULL && walkBusy > 0)
+            pthread_cond_wait(&walkCond, &walkLock);
+        if(walkHead == NULL){
+            //adeia oura kai kaneis de diavazei: telos
+            pthread_mutex_unlock(&walkLock);
+            break;
+        }
+        d = walkHead;
+        walkHead = d->next;
+        pthread_mutex_unlock(&walkLock);
+
+        walkOne(d->path, buf);
+        free(d->path);
+        free(d);
+
+        pthread_mutex_lock(&walkLock);
+        if(--walkBusy == 0)
+            pthread_cond_broadcast(&walkCond);
+        pthread_mutex_unlock(&walkLock);
+    }
+    free(buf);
+    return NULL;
+}
+
+static void usage(const char *prog){
+    fprintf(stderr, "usage: %s [-lr] [-j threads] <extension> <year> <n|o>\n", prog);
+    exit(2);
+}
+
+int main(int argc, char **argv){
+    pthread_t *tid;
+    struct tm tm;
+    walkDir *d;
+    int c, i, nThreads = 0, rescan = 0;
+
+    while((c = getopt(argc, argv, "lrj:")) != -1){
+        if(c == 'l')
+            walkList = 1;
+        else if(c == 'r')
+            rescan = 1;
+        else if(c != 'j' || (nThreads = atoi(optarg)) <= 0)
+            usage(argv[0]);
+    }
+    if(argc - optind != 3)
+        usage(argv[0]);
+    if(strcmp(argv[optind + 2], "n") == 0)
+        walkNewer = 1;
+    else if(strcmp(argv[optind + 2], "o") == 0)
+        walkNewer = 0;
+    else
+        usage(argv[0]);
+    snprintf(walkPattern, sizeof(walkPattern), "*.%s", argv[optind]);
+
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_year = atoi(argv[optind + 1]) - 1900;
+    tm.tm_mday = 1;
+    tm.tm_isdst = -1;
+    walkCutoff = mktime(&tm);
+
+    clock_gettime(CLOCK_REALTIME, &idxStart);
+    if(!rescan)
+        idxLoad();
+
+    //mkdir -p output
+    if(!walkList && mkdir("output", 0777) < 0 && errno != EEXIST){
+        perror("mkdir output");
+        return 1;
+    }
+    if(!walkList && (walkOut = open("output", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0){
+        perror("open output");
+        return 1;
+    }
+
+    if(nThreads <= 0)
+        nThreads = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+    tid = malloc(nThreads * sizeof(pthread_t));
+    d = malloc(sizeof(walkDir));
+    if(tid == NULL || d == NULL || (d->path = strdup(".")) == NULL){
+        perror("malloc");
+        return 1;
+    }
+    d->next = NULL;
+    walkHead = d;
+    walkBusy = 1;
+
+    for(i = 0; i < nThreads; i++)
+        if(pthread_create(&tid[i], NULL, walkWorker, NULL) != 0){
+            perror("pthread_create");
+            return 1;
+        }
+    for(i = 0; i < nThreads; i++)
+        pthread_join(tid[i], NULL);
+
+    idxSave();
+    free(tid);
+    if(walkOut >= 0)
+        close(walkOut);
+    return atomic_load(&walkErrors) ? 1 : 0;
+}
@@ -1,5 +1,11 @@
 #lab2_exe se fish
 function sort_files -a file_extension year flag -description="sort_files(file_extension,year,flag)"
+    # to lab2_exe.c (gcc -O2 -pthread -o sort_files lab2_exe.c) kanei to idio
+    # me threads kai renameat, xwris ena mv ana arxeio
+    if command -q sort_files
+        command sort_files $file_extension $year $flag
+        return
+    end
     mkdir -p output
     if test $flag = "n"
         find ./ -type f -newermt $year-01-01 -name "*.$file_extension" | xargs -I '{}' mv '{}' output
@@ -17,11 +23,18 @@ end
 
 
 
+# auth h dey8erh ekdosh einai pou isxyei sto fish. To sort_files binary kanei
+# oti kai h prwth (mkdir -p output, mono -type f), ara kai edw to idio
 function sort_files
+if command -q sort_files
+    command sort_files $argv[1] $argv[2] $argv[3]
+    return
+end
+mkdir -p output
 switch $argv[3]
     case o
-        find ./ -name "*.$argv[1]" ! -newermt "$argv[2]/01/01"|xargs -I {} mv '{}' ./output
+        find ./ -type f -name "*.$argv[1]" ! -newermt "$argv[2]/01/01"|xargs -I {} mv '{}' ./output
     case n
-        find ./ -name "*.$argv[1]" -newermt "$argv[2]/01/01"|xargs -I {} mv '{}' ./output
+        find ./ -type f -name "*.$argv[1]" -newermt "$argv[2]/01/01"|xargs -I {} mv '{}' ./output
     end
 end
\ No newline at end of file
@@ -1,54 +1,837 @@
 
+#define _GNU_SOURCE
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/wait.h>
 #include <limits.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sched.h>
+#include <dirent.h>
+#include <linux/mempolicy.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 
 //askhsh3 OS
 //-----------------------------------------------
 //https://stackoverflow.com/questions/9148670/how-to-fork-n-child-processes-correctly-in-c/9148694
 
-void minmaxAllListsFork( int **numbers, int nList, int *nElem ){
-    //pid_t pid;
-    //int minmax[2];
-    //minmax[0] = INT_MAX; //0 gia elaxisth timh
-    //minmax[1] = INT_MIN; //1 gia megisth timh
-    int i,pid;
-    //fork() nList 8ygatrikes
+//minmax kernels: minmax[0] elaxisth, minmax[1] megisth, ka8e stoixeio elegxetai kai gia ta 2
+static void minmaxScalar(const int *a, int n, int minmax[2]){
+    int j;
+    for(j = 0 ; j < n ; j++){
+        if(minmax[0] > a[j])
+            minmax[0] = a[j];
+        if(minmax[1] < a[j])
+            minmax[1] = a[j];
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+static void minmaxAVX2(const int *a, int n, int minmax[2]){
+    __m256i vmin = _mm256_set1_epi32(minmax[0]);
+    __m256i vmax = _mm256_set1_epi32(minmax[1]);
+    int j = 0;
+    //2 registers ana epanalhpsh gia na kryftei to latency twn min/max
+    for(; j + 16 <= n ; j += 16){
+        __m256i x0 = _mm256_loadu_si256((const __m256i *)(a + j));
+        __m256i x1 = _mm256_loadu_si256((const __m256i *)(a + j + 8));
+        vmin = _mm256_min_epi32(vmin, _mm256_min_epi32(x0, x1));
+        vmax = _mm256_max_epi32(vmax, _mm256_max_epi32(x0, x1));
+    }
+    for(; j + 8 <= n ; j += 8){
+        __m256i x = _mm256_loadu_si256((const __m256i *)(a + j));
+        vmin = _mm256_min_epi32(vmin, x);
+        vmax = _mm256_max_epi32(vmax, x);
+    }
+    //horizontal reduce: 256 -> 128 -> 64 -> 32
+    __m128i mn = _mm_min_epi32(_mm256_castsi256_si128(vmin), _mm256_extracti128_si256(vmin, 1));
+    __m128i mx = _mm_max_epi32(_mm256_castsi256_si128(vmax), _mm256_extracti128_si256(vmax, 1));
+    mn = _mm_min_epi32(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(1, 0, 3, 2)));
+    mx = _mm_max_epi32(mx, _mm_shuffle_epi32(mx, _MM_SHUFFLE(1, 0, 3, 2)));
+    mn = _mm_min_epi32(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(2, 3, 0, 1)));
+    mx = _mm_max_epi32(mx, _mm_shuffle_epi32(mx, _MM_SHUFFLE(2, 3, 0, 1)));
+    minmax[0] = _mm_cvtsi128_si32(mn);
+    minmax[1] = _mm_cvtsi128_si32(mx);
+    //oura
+    minmaxScalar(a + j, n - j, minmax);
+}
+
+__attribute__((target("avx512f")))
+static void minmaxAVX512(const int *a, int n, int minmax[2]){
+    __m512i vmin = _mm512_set1_epi32(minmax[0]);
+    __m512i vmax = _mm512_set1_epi32(minmax[1]);
+    int j = 0;
+    for(; j + 32 <= n ; j += 32){
+        __m512i x0 = _mm512_loadu_si512((const void *)(a + j));
+        __m512i x1 = _mm512_loadu_si512((const void *)(a + j + 16));
+        vmin = _mm512_min_epi32(vmin, _mm512_min_epi32(x0, x1));
+        vmax = _mm512_max_epi32(vmax, _mm512_max_epi32(x0, x1));
+    }
+    if(j < n){
+        //h oura me maska, xwris scalar loop
+        __mmask16 m;
+        for(; j < n ; j += 16){
+            m = (n - j >= 16) ? (__mmask16)0xFFFF : (__mmask16)((1u << (n - j)) - 1);
+            __m512i x = _mm512_maskz_loadu_epi32(m, a + j);
+            vmin = _mm512_mask_min_epi32(vmin, m, vmin, x);
+            vmax = _mm512_mask_max_epi32(vmax, m, vmax, x);
+        }
+    }
+    minmax[0] = _mm512_reduce_min_epi32(vmin);
+    minmax[1] = _mm512_reduce_max_epi32(vmax);
+}
+#endif
+
+//dialegetai mia fora sthn prwth klhsh analoga me ton epeksergasth
+static void (*minmaxKernel)(const int *, int, int *) = 0;
+
+static void minmaxInitKernel(void){
+    if(minmaxKernel != 0)
+        return;
+    minmaxKernel = minmaxScalar;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f"))
+        minmaxKernel = minmaxAVX512;
+    else if(__builtin_cpu_supports("avx2"))
+        minmaxKernel = minmaxAVX2;
+#endif
+}
+
+static void minmaxList(const int *a, int n, int minmax[2]){
+    minmaxInitKernel();
+    minmaxKernel(a, n, minmax);
+}
+
+//-----------------------------------------------
+//genikeumeno reduction: me ena perasma ana 8ygatrikh ypologizontai osa
+//aggregates zhth8oun sto mask. Ta merika apotelesmata (aggState) einai
+//mergeable, opote mia nea statistikh den xreiazetai allo perasma sth mnhmh.
+
+#define AGG_MIN     0x01
+#define AGG_MAX     0x02
+#define AGG_SUM     0x04
+#define AGG_COUNT   0x08
+#define AGG_MEANVAR 0x10 //mesh timh kai diaspora
+#define AGG_ARGMIN  0x20
+#define AGG_ARGMAX  0x40
+#define AGG_TOPK    0x80
+
+#define AGG_MAXTOPK 64
+
+typedef struct {
+    int mask;
+    int min, max;
+    int argminList, argmaxList; //se poia lista brisketai to argmin/argmax
+    long argmin, argmax;        //8esh mesa sth lista
+    long count;
+    long long sum;
+    double mean, m2;            //m2 = sum (x - mean)^2, diaspora = m2 / count
+    int k, nTop;
+    int top[AGG_MAXTOPK];       //min-heap me ta k megalytera stoixeia
+} aggState;
+
+//k: posa megalytera stoixeia krataei to AGG_TOPK. To poly AGG_MAXTOPK (64):
+//megalytero k kovetai sto AGG_MAXTOPK, opote o kalwn koitaei to s->k/nTop.
+void aggInit(aggState *s, int mask, int k){
+    memset(s, 0, sizeof(*s));
+    s->mask = mask;
+    s->min = INT_MAX;
+    s->max = INT_MIN;
+    s->argmin = s->argmax = -1;
+    s->argminList = s->argmaxList = -1;
+    s->k = (k < 0) ? 0 : (k > AGG_MAXTOPK) ? AGG_MAXTOPK : k;
+}
+
+static void aggTopPush(aggState *s, int v){
+    int i, c;
+    if(s->nTop < s->k){ //sift up
+        i = s->nTop++;
+        while(i > 0 && s->top[(i - 1) / 2] > v){
+            s->top[i] = s->top[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        s->top[i] = v;
+        return;
+    }
+    if(s->k == 0 || v <= s->top[0])
+        return;
+    i = 0; //antikatastash ths rizas kai sift down
+    for(;;){
+        c = 2 * i + 1;
+        if(c >= s->nTop)
+            break;
+        if(c + 1 < s->nTop && s->top[c + 1] < s->top[c])
+            c++;
+        if(s->top[c] >= v)
+            break;
+        s->top[i] = s->top[c];
+        i = c;
+    }
+    s->top[i] = v;
+}
+
+//pros8etei sto s to (count, mean, m2) enos allou kommatiou (Chan et al.)
+static void aggMergeMoments(aggState *s, long n, double mean, double m2){
+    long tot = s->count + n;
+    double delta;
+    if(n == 0)
+        return;
+    delta = mean - s->mean;
+    s->mean += delta * n / tot;
+    s->m2 += m2 + delta * delta * ((double)s->count * n / tot);
+}
+
+//ena perasma panw sto a[0..n) ths listas list
+void aggScan(aggState *s, int list, const int *a, long n){
+    int mask = s->mask;
+    long j;
+
+    if(n <= 0)
+        return;
+
+    if((mask & ~(AGG_MIN | AGG_MAX | AGG_COUNT)) == 0){
+        //mono akraia: o vectorised kernel ftanei
+        int minmax[2];
+        minmax[0] = s->min;
+        minmax[1] = s->max;
+        minmaxList(a, (int)n, minmax);
+        s->min = minmax[0];
+        s->max = minmax[1];
+        s->count += n;
+        return;
+    }
+
+    int mn = s->min, mx = s->max;
+    long amin = -1, amax = -1;
+    long long sum = 0;
+    __int128 sumsq = 0;
+    //xwris argmin/argmax akoma, to prwto stoixeio metraei kai otan isoutai
+    //me to INT_MAX/INT_MIN ths arxikopoihshs (p.x. lista mono me INT_MAX)
+    if(s->argminList < 0 && a[0] <= mn){
+        mn = a[0];
+        amin = 0;
+    }
+    if(s->argmaxList < 0 && a[0] >= mx){
+        mx = a[0];
+        amax = 0;
+    }
+    for(j = 0; j < n; j++){
+        int v = a[j];
+        if(v < mn){
+            mn = v;
+            amin = j;
+        }
+        if(v > mx){
+            mx = v;
+            amax = j;
+        }
+        sum += v;
+        if(mask & AGG_MEANVAR)
+            sumsq += (long long)v * v;
+        if(mask & AGG_TOPK)
+            aggTopPush(s, v);
+    }
+    if(amin >= 0){
+        s->argmin = amin;
+        s->argminList = list;
+    }
+    if(amax >= 0){
+        s->argmax = amax;
+        s->argmaxList = list;
+    }
+    s->min = mn;
+    s->max = mx;
+    if(mask & AGG_MEANVAR){
+        //akribhs arith8htikh se __int128 prin th metatroph se double
+        __int128 num = (__int128)n * sumsq - (__int128)sum * sum;
+        aggMergeMoments(s, n, (double)sum / n, (double)num / n);
+    }
+    s->sum += sum;
+    s->count += n;
+}
+
+//merge tou src sto dst, h seira twn merge den allazei to apotelesma
+void aggMerge(aggState *dst, const aggState *src){
+    int i;
+    if(src->min < dst->min || (src->min == dst->min && src->argminList >= 0 &&
+       (dst->argminList < 0 || src->argminList < dst->argminList ||
+        (src->argminList == dst->argminList && src->argmin < dst->argmin)))){
+        dst->argmin = src->argmin;
+        dst->argminList = src->argminList;
+    }
+    if(src->max > dst->max || (src->max == dst->max && src->argmaxList >= 0 &&
+       (dst->argmaxList < 0 || src->argmaxList < dst->argmaxList ||
+        (src->argmaxList == dst->argmaxList && src->argmax < dst->argmax)))){
+        dst->argmax = src->argmax;
+        dst->argmaxList = src->argmaxList;
+    }
+    if(src->min < dst->min)
+        dst->min = src->min;
+    if(src->max > dst->max)
+        dst->max = src->max;
+    if(dst->mask & AGG_MEANVAR)
+        aggMergeMoments(dst, src->count, src->mean, src->m2);
+    dst->sum += src->sum;
+    dst->count += src->count;
+    for(i = 0; i < src->nTop; i++)
+        aggTopPush(dst, src->top[i]);
+}
+
+double aggVariance(const aggState *s){
+    return (s->count > 0) ? s->m2 / s->count : 0.0;
+}
+
+//-----------------------------------------------
+//topo8ethsh workers se dual-socket mhxanhmata: h 8ygatrikh i mporei na
+//karfw8ei se enan pyrhna, oi selides ths listas i na metaferoun (mbind) h na
+//desmeytoun (first touch) ston kombo tou pyrhna, kai na metrh8oun ta bytes
+//pou diabasthkan topika kai apomakrysmena. Xwris libnuma, me syscalls.
+
+#define PLACE_PIN        0x1 //sched_setaffinity ana 8ygatrikh
+#define PLACE_MBIND      0x2 //metafora selidwn ths listas ston kombo ths 8ygatrikhs
+#define PLACE_REPORT     0x4 //metrhsh topikwn/apomakrysmenwn bytes
+
+#define PLACE_MAXNODES 1024
+
+//o i-ostos epitrepomenos pyrhnas (kyklika)
+static int placeCpu(int worker){
+    cpu_set_t set;
+    int c, n = 0, count;
+    if(sched_getaffinity(0, sizeof(set), &set) < 0)
+        return -1;
+    count = CPU_COUNT(&set);
+    if(count == 0)
+        return -1;
+    worker %= count;
+    for(c = 0; c < CPU_SETSIZE; c++)
+        if(CPU_ISSET(c, &set) && n++ == worker)
+            return c;
+    return -1;
+}
+
+//o NUMA kombos tou pyrhna cpu apo to sysfs, 0 an den yparxei NUMA
+static int placeNode(int cpu){
+    char path[64];
+    struct dirent *de;
+    int node = 0;
+    DIR *d;
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    if((d = opendir(path)) == NULL)
+        return 0;
+    while((de = readdir(d)) != NULL)
+        if(sscanf(de->d_name, "node%d", &node) == 1)
+            break;
+    closedir(d);
+    return node;
+}
+
+static void placePin(int cpu){
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    sched_setaffinity(0, sizeof(set), &set);
+}
+
+//oi olokleres selides tou [a, a+n) metaferontai ston kombo node.
+//Prosoxh: to mbind douleuei me selides, ara gia lista apo malloc metaferei
+//(kai desmeuei me MPOL_BIND) kai oti allo moirazetai tis akraies selides,
+//p.x. to telos ths prohgoumenhs listas h alla antikeimena tou heap.
+//Gia akribh topo8ethsh oi listes prepei na erxontai apo placeAllocList.
+static void placeMbind(const int *a, long n, int node){
+    unsigned long mask[PLACE_MAXNODES / (8 * sizeof(unsigned long))];
+    long page = sysconf(_SC_PAGESIZE);
+    uintptr_t lo = (uintptr_t)a & ~(uintptr_t)(page - 1);
+    uintptr_t hi = ((uintptr_t)(a + n) + page - 1) & ~(uintptr_t)(page - 1);
+    if(n <= 0 || node < 0 || node >= PLACE_MAXNODES)
+        return;
+    memset(mask, 0, sizeof(mask));
+    mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+    if(syscall(SYS_mbind, lo, hi - lo, MPOL_BIND, mask, (unsigned long)PLACE_MAXNODES, MPOL_MF_MOVE) < 0)
+        perror("mbind");
+}
+
+//bytes[0] += topika, bytes[1] += apomakrysmena, me move_pages se query mode
+static void placeCount(const int *a, long n, int node, long long bytes[2]){
+    enum { BATCH = 1024 };
+    void *pages[BATCH];
+    int status[BATCH];
+    long page = sysconf(_SC_PAGESIZE);
+    uintptr_t p = (uintptr_t)a & ~(uintptr_t)(page - 1);
+    uintptr_t lo = (uintptr_t)a, hi = (uintptr_t)(a + n);
+    int i, cnt;
+    while(n > 0 && p < hi){
+        for(cnt = 0; cnt < BATCH && p + (uintptr_t)cnt * page < hi; cnt++)
+            pages[cnt] = (void *)(p + (uintptr_t)cnt * page);
+        if(syscall(SYS_move_pages, 0, (unsigned long)cnt, pages, NULL, status, 0) < 0)
+            return;
+        for(i = 0; i < cnt; i++){
+            uintptr_t s = (uintptr_t)pages[i], e = s + page;
+            long long len = (long long)((e < hi ? e : hi) - (s > lo ? s : lo));
+            if(status[i] == node)
+                bytes[0] += len;
+            else if(status[i] >= 0)
+                bytes[1] += len;
+        }
+        p += (uintptr_t)cnt * page;
+    }
+}
+
+//first touch: h lista desmeuetai enw to thread einai proswrina karfwmeno
+//ston pyrhna tou worker, ara oi selides ths pane ston kombo tou. Th gemizei
+//meta o kalwn kai th dinei ws numbers[worker]. Apodesmeuetai me placeFreeList.
+int *placeAllocList(long n, int worker){
+    cpu_set_t old;
+    int cpu = placeCpu(worker);
+    size_t len = sizeof(int) * (size_t)(n > 0 ? n : 1);
+    int *a;
+    sched_getaffinity(0, sizeof(old), &old);
+    if(cpu >= 0)
+        placePin(cpu);
+    a = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(a != MAP_FAILED)
+        memset(a, 0, len); //first touch
+    sched_setaffinity(0, sizeof(old), &old);
+    return (a == MAP_FAILED) ? NULL : a;
+}
+
+//apodesmeush listas apo placeAllocList (einai mmap, oxi malloc: oxi free())
+void placeFreeList(int *a, long n){
+    if(a != NULL)
+        munmap(a, sizeof(int) * (size_t)(n > 0 ? n : 1));
+}
+
+//h i-osth 8ygatrikh kanei aggScan sth lista i kai stelnei to aggState ston
+//patera me pipe. Epistrefei pinaka nList apotelesmatwn (free apo ton kalounta)
+//kai, an total != NULL, to merge olwn twn listwn. Me PLACE_REPORT kai
+//bytes != NULL, bytes[0]/bytes[1] = topika/apomakrysmena bytes pou skanarisan.
+typedef struct {
+    aggState st;
+    long long bytes[2];
+} reduceMsg;
+
+//diavazei to apotelesma ths 8ygatrikhs i, kleinei to pipe ths kai th perimenei
+static void reduceCollect(int i, int fd, pid_t pid, aggState *res, aggState *total, long long bytes[2]){
+    reduceMsg msg;
+    size_t got = 0;
+    ssize_t r;
+    while(got < sizeof(msg) && (r = read(fd, (char *)&msg + got, sizeof(msg) - got)) > 0)
+        got += r;
+    close(fd);
+    waitpid(pid, NULL, 0);
+    if(got != sizeof(msg)){
+        fprintf(stderr, "reduce: child %d sent no result\n", i);
+        exit(1);
+    }
+    res[i] = msg.st;
+    if(total)
+        aggMerge(total, &res[i]);
+    if(bytes){
+        bytes[0] += msg.bytes[0];
+        bytes[1] += msg.bytes[1];
+    }
+}
+
+aggState *reduceAllListsPlaced( int **numbers, int nList, int *nElem, int mask, int k, aggState *total,
+                                int place, long long bytes[2] ){
+    int i, done = 0, fd[2];
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int window = (ncpu > 0) ? (int)ncpu : 1; //to poly toses 8ygatrikes (kai pipes) zwntanes
+    pid_t pid;
+    aggState *res = malloc(sizeof(aggState) * (nList ? nList : 1));
+    int *rfd = malloc(sizeof(int) * (nList ? nList : 1));
+    pid_t *pids = malloc(sizeof(pid_t) * (nList ? nList : 1));
+    if(!res || !rfd || !pids){
+        perror("malloc");
+        exit(1);
+    }
+    if(bytes)
+        bytes[0] = bytes[1] = 0;
+    if(total)
+        aggInit(total, mask, k);
+
+    //fork() mia 8ygatrikh ana lista, to poly window parallhla: otan gemisei
+    //to para8yro mazeuetai h palaioterh, ara ta anoixta fds menoun liga
     for(i = 0; i < nList; i++) {
-    pid = fork();
-    if(pid < 0) { //error
+        int cpu = (place & (PLACE_PIN | PLACE_MBIND | PLACE_REPORT)) ? placeCpu(i) : -1;
+        int node = (cpu >= 0) ? placeNode(cpu) : 0;
+        if(i - done == window){
+            reduceCollect(done, rfd[done], pids[done], res, total, bytes);
+            done++;
+        }
+        //to mbind ginetai ston patera prin to fork, giati meta oi selides
+        //einai koines me th 8ygatrikh kai to MPOL_MF_MOVE tis prospernaei
+        if((place & PLACE_MBIND) && cpu >= 0)
+            placeMbind(numbers[i], nElem[i], node);
+        //an teleiwsan fds h processes, mazeuw mia akomh kai ksanadokimazw
+        while(pipe(fd) < 0){
+            if(done == i){
+                perror("pipe");
+                exit(1);
+            }
+            reduceCollect(done, rfd[done], pids[done], res, total, bytes);
+            done++;
+        }
+        while((pid = fork()) < 0){
+            if(done == i){
+                perror("fork");
+                exit(1);
+            }
+            reduceCollect(done, rfd[done], pids[done], res, total, bytes);
+            done++;
+        }
+        if (pid == 0) { //mpainw 8ygatrikh
+            reduceMsg msg;
+            memset(&msg, 0, sizeof(msg));
+            close(fd[0]);
+            if((place & PLACE_PIN) && cpu >= 0)
+                placePin(cpu);
+            aggInit(&msg.st, mask, k);
+            aggScan(&msg.st, i, numbers[i], nElem[i]);
+            if(place & PLACE_REPORT){
+                unsigned c, nd;
+                //o kombos opou trexei pragmatika h 8ygatrikh
+                if(syscall(SYS_getcpu, &c, &nd, NULL) == 0)
+                    node = (int)nd;
+                placeCount(numbers[i], nElem[i], node, msg.bytes);
+            }
+            if(write(fd[1], &msg, sizeof(msg)) != (ssize_t)sizeof(msg))
+                _exit(1);
+            _exit(0); //_exit: xwris flush twn stdio buffers tou patera
+        }
+        close(fd[1]);
+        rfd[i] = fd[0];
+        pids[i] = pid;
+    }
+
+    //3o bullet: perimenw oles tis 8ygatrikes prin epistrepsw
+    for(; done < nList; done++)
+        reduceCollect(done, rfd[done], pids[done], res, total, bytes);
+
+    free(rfd);
+    free(pids);
+    return res;
+}
+
+aggState *reduceAllListsFork( int **numbers, int nList, int *nElem, int mask, int k, aggState *total ){
+    return reduceAllListsPlaced(numbers, nList, nElem, mask, k, total, 0, NULL);
+}
+
+void minmaxAllListsFork( int **numbers, int nList, int *nElem ){
+    int i;
+    char buffer_name[32]; //minmax- + ari8mos i + '\0'
+    aggState *res = reduceAllListsFork(numbers, nList, nElem, AGG_MIN | AGG_MAX, 0, NULL);
+
+    for(i = 0; i < nList; i++){
+        int minmax[2];
+        minmax[0] = res[i].min; //0 gia elaxisth timh
+        minmax[1] = res[i].max; //1 gia megisth timh
+        sprintf(buffer_name,"minmax-%d",i);
+        writeBinary(buffer_name, minmax);
+    }
+    free(res);
+}
+
+
+//-----------------------------------------------
+//enallaktiko backend me threads: oles oi listes spane se chunks, ta chunks
+//moirazontai se ena deque ana thread kai opoio thread teleiwsei nwris kleftei
+//apo ta alla. Ka8e thread grafei ta merika minmax sth dikh tou grammh, ara
+//to merge sto telos ginetai xwris locks.
+
+#define MINMAX_CHUNK 16384 //stoixeia ana chunk (64KB)
+
+enum { MINMAX_FORK, MINMAX_THREADS };
+
+typedef struct {
+    int list;
+    int off;
+    int len;
+} minmaxChunk;
+
+typedef struct {
+    _Atomic uint64_t range; //head sta panw 32 bit, tail sta katw (mh symperilambanomeno)
+    int *partial;           //nList * 2, minmax ana lista gia auto to thread
+    char pad[64];
+} minmaxWorker;
+
+typedef struct {
+    int **numbers;
+    minmaxChunk *chunks;
+    minmaxWorker *workers;
+    int nWorkers;
+} minmaxPool;
+
+typedef struct {
+    minmaxPool *pool;
+    int id;
+} minmaxArg;
+
+//o idiokthths pairnei apo thn arxh tou deque
+static int minmaxPopFront(minmaxWorker *w){
+    uint64_t r = atomic_load(&w->range);
+    for(;;){
+        uint32_t head = r >> 32, tail = (uint32_t)r;
+        if(head >= tail)
+            return -1;
+        if(atomic_compare_exchange_weak(&w->range, &r, ((uint64_t)(head + 1) << 32) | tail))
+            return head;
+    }
+}
+
+//oi kleftes pairnoun apo to telos
+static int minmaxStealBack(minmaxWorker *w){
+    uint64_t r = atomic_load(&w->range);
+    for(;;){
+        uint32_t head = r >> 32, tail = (uint32_t)r;
+        if(head >= tail)
+            return -1;
+        if(atomic_compare_exchange_weak(&w->range, &r, ((uint64_t)head << 32) | (tail - 1)))
+            return tail - 1;
+    }
+}
+
+static void *minmaxThread(void *p){
+    minmaxArg *arg = p;
+    minmaxPool *pool = arg->pool;
+    minmaxWorker *me = &pool->workers[arg->id];
+    int c, v;
+
+    for(;;){
+        c = minmaxPopFront(me);
+        //adeio to diko mou, dokimazw ta alla ksekinwntas apo ton epomeno
+        for(v = 1; c < 0 && v < pool->nWorkers; v++)
+            c = minmaxStealBack(&pool->workers[(arg->id + v) % pool->nWorkers]);
+        if(c < 0)
+            break;
+        minmaxChunk *ch = &pool->chunks[c];
+        minmaxList(pool->numbers[ch->list] + ch->off, ch->len, me->partial + 2 * ch->list);
+    }
+    return NULL;
+}
+
+void minmaxAllListsThreads( int **numbers, int nList, int *nElem, int nThreads ){
+    int i, k, nChunks = 0;
+    char buffer_name[32];
+
+    if(nThreads <= 0)
+        nThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(nThreads <= 0)
+        nThreads = 1;
+
+    for(k = 0; k < nList; k++)
+        nChunks += (nElem[k] + MINMAX_CHUNK - 1) / MINMAX_CHUNK;
+
+    minmaxPool pool;
+    pool.numbers = numbers;
+    pool.nWorkers = nThreads;
+    pool.chunks = malloc(sizeof(minmaxChunk) * (nChunks ? nChunks : 1));
+    pool.workers = malloc(sizeof(minmaxWorker) * nThreads);
+    pthread_t *tid = malloc(sizeof(pthread_t) * nThreads);
+    minmaxArg *args = malloc(sizeof(minmaxArg) * nThreads);
+    if(!pool.chunks || !pool.workers || !tid || !args)
         exit(1);
-    } else if (pid == 0) { //mpainw 8ygatrikh
-        //algori8mo 2o bullet
+
+    nChunks = 0;
+    for(k = 0; k < nList; k++){
+        int off;
+        for(off = 0; off < nElem[k]; off += MINMAX_CHUNK){
+            pool.chunks[nChunks].list = k;
+            pool.chunks[nChunks].off = off;
+            pool.chunks[nChunks].len = (nElem[k] - off < MINMAX_CHUNK) ? nElem[k] - off : MINMAX_CHUNK;
+            nChunks++;
+        }
+    }
+
+    //arxikh isomoirasia twn chunks
+    for(i = 0; i < nThreads; i++){
+        uint32_t lo = (uint64_t)nChunks * i / nThreads;
+        uint32_t hi = (uint64_t)nChunks * (i + 1) / nThreads;
+        atomic_init(&pool.workers[i].range, ((uint64_t)lo << 32) | hi);
+        pool.workers[i].partial = malloc(sizeof(int) * 2 * (nList ? nList : 1));
+        if(!pool.workers[i].partial)
+            exit(1);
+        for(k = 0; k < nList; k++){
+            pool.workers[i].partial[2 * k] = INT_MAX;
+            pool.workers[i].partial[2 * k + 1] = INT_MIN;
+        }
+    }
+
+    //o kernel dialegetai prin ksekinhsoun ta threads
+    minmaxInitKernel();
+    for(i = 0; i < nThreads; i++){
+        args[i].pool = &pool;
+        args[i].id = i;
+        if(pthread_create(&tid[i], NULL, minmaxThread, &args[i]) != 0)
+            exit(1);
+    }
+    for(i = 0; i < nThreads; i++)
+        pthread_join(tid[i], NULL);
+
+    //merge twn merikwn apotelesmatwn, idia eksodos me to fork backend
+    for(k = 0; k < nList; k++){
         int minmax[2];
-        minmax[0] = INT_MAX; //0 gia elaxisth timh
-        minmax[1] = INT_MIN; //1 gia megisth timh
-        char buffer_name[8+i]; //minmax- + 1offset+ i
-        int k;
-        for(k = 0 ; k < nList ; k++){
-                int j;
-                for(j = 0 ; j < nElem[k]; j++){
-                    if ( minmax[0] > numbers[k][j]){
-                        minmax[0] = numbers[k][j];
-                    }else if(minmax[1] < numbers[k][j]){
-                        minmax[1] = numbers[k][j];
-                    }
-                }
-                sprintf(buffer_name,"minmax-%d",i);
-                writeBinary(buffer_name, minmax);
-            }
-        exit(0); 
-    } else  { //3o bullet gia mhn exw ki alla spawns mexri na teleiwsoun oles kai katalhksw anadromika me 2^n diergasies
-        wait(NULL);
+        minmax[0] = INT_MAX;
+        minmax[1] = INT_MIN;
+        for(i = 0; i < nThreads; i++){
+            if(minmax[0] > pool.workers[i].partial[2 * k])
+                minmax[0] = pool.workers[i].partial[2 * k];
+            if(minmax[1] < pool.workers[i].partial[2 * k + 1])
+                minmax[1] = pool.workers[i].partial[2 * k + 1];
+        }
+        sprintf(buffer_name,"minmax-%d",k);
+        writeBinary(buffer_name, minmax);
+    }
+
+    for(i = 0; i < nThreads; i++)
+        free(pool.workers[i].partial);
+    free(pool.chunks);
+    free(pool.workers);
+    free(tid);
+    free(args);
+}
+
+//epilogh backend gia sygkrish fork vs threads
+void minmaxAllLists( int **numbers, int nList, int *nElem, int backend ){
+    if(backend == MINMAX_THREADS)
+        minmaxAllListsThreads(numbers, nList, nElem, 0);
+    else
+        minmaxAllListsFork(numbers, nList, nElem);
+}
+
+
+//-----------------------------------------------
+//out-of-core: ta dedomena einai binary arxeia int32 megalytera apo th mnhmh.
+//Ta arxeia ginontai mmap kai to synoliko eyros (se stoixeia) xwrizetai se
+//synexomena kommatia, ena ana 8ygatrikh. Ka8e 8ygatrikh xartografei mono to
+//kommati ths se para8yra twn MINMAX_WINDOW bytes me MADV_SEQUENTIAL, ara ka8e
+//byte diabazetai mia fora kai tipota den antigrafetai se heap.
+
+#define MINMAX_WINDOW (64L << 20) //64MB para8yro mmap
+
+static void minmaxFileRange(int fd, off_t first, off_t count, int minmax[2]){
+    long page = sysconf(_SC_PAGESIZE);
+    off_t pos = first * (off_t)sizeof(int);
+    off_t end = (first + count) * (off_t)sizeof(int);
+
+    while(pos < end){
+        off_t base = pos - pos % page; //to offset tou mmap prepei na einai page aligned
+        size_t len = (end - base < MINMAX_WINDOW) ? (size_t)(end - base) : (size_t)MINMAX_WINDOW;
+        char *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, base);
+        if(map == MAP_FAILED){
+            perror("mmap");
+            exit(1);
+        }
+        madvise(map, len, MADV_SEQUENTIAL);
+        minmaxList((const int *)(map + (pos - base)), (int)((base + (off_t)len - pos) / sizeof(int)), minmax);
+        munmap(map, len);
+        pos = base + len;
     }
 }
 
+void minmaxAllFilesMmap( char **files, int nFiles, int nWorkers ){
+    int f, w;
+    off_t total = 0;
+    char buffer_name[32];
+
+    if(nWorkers <= 0)
+        nWorkers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(nWorkers <= 0)
+        nWorkers = 1;
+
+    int *fds = malloc(sizeof(int) * (nFiles ? nFiles : 1));
+    off_t *nElem = malloc(sizeof(off_t) * (nFiles ? nFiles : 1));
+    int (*pd)[2] = malloc(sizeof(*pd) * nWorkers);
+    int *partial = malloc(sizeof(int) * 2 * (nFiles ? nFiles : 1));
+    int *minmax = malloc(sizeof(int) * 2 * (nFiles ? nFiles : 1));
+    if(!fds || !nElem || !pd || !partial || !minmax)
+        exit(1);
+
+    for(f = 0; f < nFiles; f++){
+        struct stat st;
+        fds[f] = open(files[f], O_RDONLY);
+        if(fds[f] < 0 || fstat(fds[f], &st) < 0){
+            fprintf(stderr, "cannot open %s\n", files[f]);
+            exit(1);
+        }
+        nElem[f] = st.st_size / (off_t)sizeof(int); //ta perisseuomena bytes agnoountai
+        total += nElem[f];
+        minmax[2 * f] = INT_MAX;
+        minmax[2 * f + 1] = INT_MIN;
+    }
+
+    for(w = 0; w < nWorkers; w++){
+        if(pipe(pd[w]) < 0){
+            perror("pipe");
+            exit(1);
+        }
+        int pid = fork();
+        if(pid < 0){
+            exit(1);
+        } else if(pid == 0){
+            //to [lo, hi) ths 8ygatrikhs panw sth synenwsh olwn twn arxeiwn
+            off_t lo = total * w / nWorkers;
+            off_t hi = total * (w + 1) / nWorkers;
+            off_t start = 0;
+            close(pd[w][0]);
+            for(f = 0; f < nFiles; f++){
+                off_t a = (lo > start) ? lo : start;
+                off_t b = (hi < start + nElem[f]) ? hi : start + nElem[f];
+                partial[2 * f] = INT_MAX;
+                partial[2 * f + 1] = INT_MIN;
+                if(a < b)
+                    minmaxFileRange(fds[f], a - start, b - a, partial + 2 * f);
+                start += nElem[f];
+            }
+            if(write(pd[w][1], partial, sizeof(int) * 2 * nFiles) != (ssize_t)(sizeof(int) * 2 * nFiles))
+                _exit(1);
+            close(pd[w][1]);
+            _exit(0);
+        }
+        close(pd[w][1]);
+    }
 
+    //merge: o pateras diabazei ta merika apo ka8e pipe
+    for(w = 0; w < nWorkers; w++){
+        size_t want = sizeof(int) * 2 * nFiles, got = 0;
+        ssize_t r;
+        while(got < want && (r = read(pd[w][0], (char *)partial + got, want - got)) > 0)
+            got += r;
+        close(pd[w][0]);
+        if(got != want){
+            fprintf(stderr, "worker %d failed\n", w);
+            exit(1);
+        }
+        for(f = 0; f < nFiles; f++){
+            if(minmax[2 * f] > partial[2 * f])
+                minmax[2 * f] = partial[2 * f];
+            if(minmax[2 * f + 1] < partial[2 * f + 1])
+                minmax[2 * f + 1] = partial[2 * f + 1];
+        }
+    }
+    for(w = 0; w < nWorkers; w++)
+        wait(NULL);
+
+    for(f = 0; f < nFiles; f++){
+        close(fds[f]);
+        sprintf(buffer_name,"minmax-%d",f);
+        writeBinary(buffer_name, minmax + 2 * f);
+    }
 
-    
-    return;
-    
+    free(fds);
+    free(nElem);
+    free(pd);
+    free(partial);
+    free(minmax);
 }
\ No newline at end of file
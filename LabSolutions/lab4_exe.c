@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdio.h>
@@ -6,8 +7,22 @@
 #include <assert.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
+#include <setjmp.h>
+#include <spawn.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/sendfile.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <stdio_ext.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/signalfd.h>
+#include <poll.h>
+#include <limits.h>
 
-#define MAXARGS 10
+#define ARENABLOCK 4096  // minimum size of a parse arena block
 
 // All commands have at least a type. Have looked at the type, the code
 // typically casts the *cmd to some specific cmd type.
@@ -17,13 +32,17 @@ struct cmd {
 
 struct execcmd {
   int type;              // ' '
-  char *argv[MAXARGS];   // arguments to the command to be exec-ed
+  char **argv;           // arguments to the command to be exec-ed
+  char **eargv;          // end of each argument in the line, see nulterminate
+  int argc, maxargs;     // argv grows in the arena, argv[argc] == 0
+  char *path;            // argv[0] resolved through the hash table, or 0
 };
 
 struct redircmd {
   int type;          // < or >
   struct cmd *cmd;   // the command to be run (e.g., an execcmd)
   char *file;        // the input/output file0
+  char *efile;       // end of file name in the line
   int flags;         // flags for open() indicating read or write
   int fd;            // the file descriptor number to use for the file
 };
@@ -34,141 +53,1838 @@ struct pipecmd {
   struct cmd *right; // right side of pipe
 };
 
+struct listcmd {
+  int type;          // ;
+  struct cmd *left;  // run first
+  struct cmd *right; // run after left has finished
+};
+
+struct backcmd {
+  int type;          // &
+  struct cmd *cmd;   // the pipeline to run in the background
+};
+
 int fork1(void);  // Fork but exits on failure.
+void *aalloc(size_t);
+void areset(void);
 struct cmd *parsecmd(char*);
+int runpipeline(struct cmd*);
+int runline(struct cmd*);
+int zrunpipeline(struct cmd*);
+void reaped(pid_t, int, struct rusage*);
+int spawncmd(struct cmd*, int, int);
+void hashcmd(struct cmd*);
+int stripprefix(struct cmd*, char*);
+
+extern char **environ;
+int usespawn = 1;  // 0: every command goes through fork1()+runcmd (sh -F)
+int pipesize = 0;  // F_SETPIPE_SZ for pipeline pipes, 0 = kernel default (sh -P)
+sigset_t chldmask, origmask;  // SIGCHLD, and the mask the shell started with
+int logfd = -1;    // -L file: one JSON line per command run
+int zygotefd = -1; // -Z: socket to the fork server
+int databuiltin(struct execcmd*);
+int rundatabuiltin(struct execcmd*);
+
+
+/*****************************************************************************/
+/*      Run command.  Never returns. You need to implement this function     */
+/*****************************************************************************/
+
+void
+runcmd(struct cmd *cmd)
+{
+  int temp_dir;
+  struct execcmd *ecmd;
+  struct redircmd *rcmd;
+
+  if(cmd == 0)
+    exit(0);
+  
+  switch(cmd->type){
+  default:
+    fprintf(stderr, "unknown runcmd\n");
+    exit(-1);
+
+  case ' ':                                       
+    ecmd = (struct execcmd*)cmd;
+    if(ecmd->argv[0] == 0)
+      exit(0);
+    if(databuiltin(ecmd))
+      exit(rundatabuiltin(ecmd));
+    //fprintf(stderr, "exec not implemented\n");
+    // Your code here ...
+    //aples entoles na ektelestoun . boh8eia : exec,man 3 exec
+    // hashcmd() has already searched $PATH in the shell, skip the search
+    if(ecmd->path)
+      execv(ecmd->path, ecmd->argv);
+    else
+      execvp(ecmd->argv[0], ecmd->argv); //execvp(const char *file, char *const argv[]);
+    //.
+    break;
+
+  case '>':                                       
+  case '<':                                       
+    rcmd = (struct redircmd*)cmd;
+    //fprintf(stderr, "temp_dir not implemented\n");
+    // Your code here ...
+    //na ginei anakateu8ynsh . boh8eia : open,close,dup
+    //anoigw proswrino directory me prosbash se ola
+    temp_dir = open(rcmd->file, rcmd->flags, 0777);
+
+    if (temp_dir < 0)
+    {
+      fprintf(stderr, "The opening of %s not done\n", rcmd->file);
+      exit(0);
+    }
+    
+    //duplication
+    if (dup2(temp_dir, rcmd->fd) < 0)                 
+    {
+      fprintf(stderr, "dup not done\n");
+      exit(0);
+    }
+
+    close(temp_dir);
+    //.
+    runcmd(rcmd->cmd);
+    break;
+
+  case '|':
+    // flat pipeline: ola ta stages ksekinane apo edw kai ta perimenoume ola
+    exit(runpipeline(cmd));
+
+  case ';':
+  case '&':
+    sigprocmask(SIG_BLOCK, &chldmask, 0);  // runline waits for its own children
+    exit(runline(cmd));
+  }    
+  exit(0);
+}
+
+
+/*****************************************************************************/
+/*      Command location cache (like the sh "hash" builtin)                  */
+/*****************************************************************************/
+
+#define NHASH 64
+
+struct hashent {
+  char *name;            // argv[0] as typed
+  char *path;            // where it was found in $PATH
+  int hits;
+  struct hashent *next;
+};
+
+struct hashent *cmdhash[NHASH];
+char *hashedpath;        // $PATH the table was filled with
+
+void
+hashclear(void)
+{
+  struct hashent *h, *nx;
+  int i;
+
+  for(i = 0; i < NHASH; i++){
+    for(h = cmdhash[i]; h; h = nx){
+      nx = h->next;
+      free(h->name);
+      free(h->path);
+      free(h);
+    }
+    cmdhash[i] = 0;
+  }
+}
+
+unsigned
+hashname(char *s)
+{
+  unsigned h = 5381;
+
+  while(*s)
+    h = h*33 + (unsigned char)*s++;
+  return h % NHASH;
+}
+
+// Search $PATH once, the way execvp does. Empty entries mean ".".
+char*
+pathsearch(char *name, char *path)
+{
+  struct stat st;
+  char *p, *e, *full;
+  int n;
+
+  for(p = path; ; p = e+1){
+    e = strchr(p, ':');
+    if(e == 0)
+      e = p + strlen(p);
+    n = e - p;
+    full = malloc(n + strlen(name) + 3);
+    assert(full);
+    if(n == 0)
+      sprintf(full, "./%s", name);
+    else
+      sprintf(full, "%.*s/%s", n, p, name);
+    if(stat(full, &st) == 0 && S_ISREG(st.st_mode) && access(full, X_OK) == 0)
+      return full;
+    free(full);
+    if(*e == 0)
+      return 0;
+  }
+}
+
+// The table is only valid for the $PATH it was filled with.
+void
+hashcheckpath(void)
+{
+  char *path = getenv("PATH");
+
+  if(path == 0)
+    path = "/bin:/usr/bin";
+  if(hashedpath && strcmp(hashedpath, path) == 0)
+    return;
+  hashclear();
+  free(hashedpath);
+  hashedpath = strdup(path);
+}
+
+// After cd, entries found through relative $PATH dirs point elsewhere.
+void
+hashcd(void)
+{
+  char *p;
+
+  if(hashedpath == 0)
+    return;
+  for(p = hashedpath; ; p++){
+    if((p == hashedpath || p[-1] == ':') && *p != '/'){
+      hashclear();
+      return;
+    }
+    p = strchr(p, ':');
+    if(p == 0)
+      return;
+  }
+}
+
+// Fill ecmd->path for the execcmd at the bottom of cmd.
+void
+hashcmd(struct cmd *cmd)
+{
+  struct execcmd *ecmd;
+  struct hashent *h;
+  unsigned b;
+  char *path;
+
+  while(cmd && (cmd->type == '<' || cmd->type == '>'))
+    cmd = ((struct redircmd*)cmd)->cmd;
+  if(cmd == 0 || cmd->type != ' ')
+    return;
+  ecmd = (struct execcmd*)cmd;
+  if(ecmd->argv[0] == 0 || strchr(ecmd->argv[0], '/'))
+    return;
+
+  hashcheckpath();
+  b = hashname(ecmd->argv[0]);
+  for(h = cmdhash[b]; h; h = h->next)
+    if(strcmp(h->name, ecmd->argv[0]) == 0)
+      break;
+  if(h == 0){
+    if((path = pathsearch(ecmd->argv[0], hashedpath)) == 0)
+      return;  // not found: let exec report it, don't cache misses
+    h = malloc(sizeof(*h));
+    assert(h);
+    h->name = strdup(ecmd->argv[0]);
+    h->path = path;
+    h->hits = 0;
+    h->next = cmdhash[b];
+    cmdhash[b] = h;
+  }
+  h->hits++;
+  ecmd->path = h->path;
+}
+
+// hash: list the table, hash -r: forget everything
+void
+hashbuiltin(char **argv)
+{
+  struct hashent *h;
+  int i, any = 0;
+
+  if(argv[1] && strcmp(argv[1], "-r") == 0){
+    hashclear();
+    return;
+  }
+  for(i = 0; i < NHASH; i++){
+    for(h = cmdhash[i]; h; h = h->next){
+      if(!any)
+        printf("hits\tcommand\n");
+      printf("%4d\t%s\n", h->hits, h->path);
+      any = 1;
+    }
+  }
+  if(!any)
+    printf("hash: hash table empty\n");
+  fflush(stdout);
+}
+
+
+/*****************************************************************************/
+/*      Spawn an exec/redir command with posix_spawn instead of fork+exec    */
+/*****************************************************************************/
+
+// posix_spawn uses clone(CLONE_VM|CLONE_VFORK) in glibc, so the shell's
+// page tables are not copied. The redircmd open/dup2 steps become file
+// actions. fdin/fdout (-1 if unused) are dup2-ed to 0/1 first, like the
+// pipe stages in runpipeline. Returns the pid, -1 on error (reported), or
+// -2 if cmd is not a plain command and must take the fork1() path.
+// posix_spawn runs the file actions while the shell is suspended (vfork),
+// so a redirection may only go there if its open can neither block nor
+// fail: an existing regular file we may access, or a new file in a
+// directory we may write. FIFOs, devices and missing files take the
+// fork1() path, where runcmd opens them in the child and names the file.
+int
+spawnfileok(struct redircmd *rcmd)
+{
+  struct stat st;
+  char dir[PATH_MAX], *slash;
+  int mode;
+
+  switch(rcmd->flags & O_ACCMODE){
+  case O_RDONLY: mode = R_OK; break;
+  case O_WRONLY: mode = W_OK; break;
+  default:       mode = R_OK|W_OK; break;
+  }
+  if(stat(rcmd->file, &st) == 0)
+    return S_ISREG(st.st_mode) && faccessat(AT_FDCWD, rcmd->file, mode, AT_EACCESS) == 0;
+  if(errno != ENOENT || !(rcmd->flags & O_CREAT))
+    return 0;
+  if(snprintf(dir, sizeof(dir), "%s", rcmd->file) >= (int)sizeof(dir))
+    return 0;
+  if((slash = strrchr(dir, '/')) == 0)
+    strcpy(dir, ".");
+  else
+    slash[slash == dir] = 0;  // "/x" -> "/", "a/x" -> "a"
+  return faccessat(AT_FDCWD, dir, W_OK|X_OK, AT_EACCESS) == 0;
+}
+
+int
+spawncmd(struct cmd *cmd, int fdin, int fdout)
+{
+  posix_spawn_file_actions_t fa;
+  posix_spawnattr_t attr;
+  struct redircmd *rcmd;
+  struct execcmd *ecmd;
+  pid_t pid;
+  int err;
+
+  hashcmd(cmd);  // resolved in the shell, also for the fork1() path
+  if(cmd == 0 || !usespawn)
+    return -2;
+  // check first that the chain ends in an execcmd with a program to run
+  for(struct cmd *c = cmd; ; c = ((struct redircmd*)c)->cmd){
+    if(c->type == ' '){
+      // cat/tee run as builtins in a forked child, see rundatabuiltin
+      if(((struct execcmd*)c)->argv[0] == 0 || databuiltin((struct execcmd*)c))
+        return -2;
+      break;
+    }
+    if(c->type != '<' && c->type != '>')
+      return -2;
+    if(!spawnfileok((struct redircmd*)c))
+      return -2;
+  }
+
+  posix_spawn_file_actions_init(&fa);
+  if(fdin >= 0)
+    posix_spawn_file_actions_adddup2(&fa, fdin, STDIN_FILENO);
+  if(fdout >= 0)
+    posix_spawn_file_actions_adddup2(&fa, fdout, STDOUT_FILENO);
+  // outer redirections first, same order as runcmd
+  while(cmd->type != ' '){
+    rcmd = (struct redircmd*)cmd;
+    posix_spawn_file_actions_addopen(&fa, rcmd->fd, rcmd->file, rcmd->flags, 0777);
+    cmd = rcmd->cmd;
+  }
+  ecmd = (struct execcmd*)cmd;
+
+  // the shell keeps SIGCHLD blocked, the command gets the mask the shell
+  // started with, like fork1() children
+  posix_spawnattr_init(&attr);
+  posix_spawnattr_setsigmask(&attr, &origmask);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+  if(ecmd->path)
+    err = posix_spawn(&pid, ecmd->path, &fa, &attr, ecmd->argv, environ);
+  else
+    err = posix_spawnp(&pid, ecmd->argv[0], &fa, &attr, ecmd->argv, environ);
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&fa);
+  if(err != 0){
+    fprintf(stderr, "cannot run %s: %s\n", ecmd->argv[0], strerror(err));
+    return -1;
+  }
+  return pid;
+}
+
+// bench N cmd...: commands/sec of the spawn path vs the fork1()+exec path.
+// cmd is the parsed line with the "bench" word already stripped.
+void
+benchcmd(struct cmd *cmd)
+{
+  struct execcmd *ecmd;
+  struct timespec t0, t1;
+  double secs[2];
+  int n = 0, i, way, pid, st, saved = usespawn;
+  char *end;
+
+  for(ecmd = (struct execcmd*)cmd; ecmd->type == '<' || ecmd->type == '>'; )
+    ecmd = (struct execcmd*)((struct redircmd*)ecmd)->cmd;
+  if(ecmd->type == ' ' && ecmd->argv[0]){
+    n = strtol(ecmd->argv[0], &end, 10);
+    if(*end || !stripprefix(cmd, ecmd->argv[0]))
+      n = 0;
+  }
+  if(n <= 0 || cmd->type == '|' || ecmd->argv[0] == 0){
+    fprintf(stderr, "usage: bench N command\n");
+    return;
+  }
+  for(way = 0; way < 2; way++){
+    usespawn = (way == 0);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(i = 0; i < n; i++){
+      if((pid = spawncmd(cmd, -1, -1)) == -2 && (pid = fork1()) == 0)
+        runcmd(cmd);
+      if(pid > 0)
+        waitpid(pid, &st, 0);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    secs[way] = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+  }
+  usespawn = saved;
+  fprintf(stderr, "spawn: %.0f cmds/sec, fork+exec: %.0f cmds/sec\n",
+          n / secs[0], n / secs[1]);
+}
+
+
+/*****************************************************************************/
+/*      cat/tee builtins that move data without user-space copies            */
+/*****************************************************************************/
+
+#define ZCHUNK (1 << 20)
+
+// Copy in to out until EOF. sendfile for file->file, splice when one side
+// is a pipe, read/write only if the kernel refuses both (e.g. a tty).
+int
+zcopy(int in, int out)
+{
+  static char buf[65536];
+  struct stat si, so;
+  enum { RW, SENDFILE, SPLICE } mode = RW;
+  ssize_t n, w, off;
+
+  if(fstat(in, &si) == 0 && fstat(out, &so) == 0){
+    if(S_ISFIFO(si.st_mode) || S_ISFIFO(so.st_mode))
+      mode = SPLICE;
+    else if(S_ISREG(si.st_mode))
+      mode = SENDFILE;
+  }
+  for(;;){
+    if(mode == SENDFILE)
+      n = sendfile(out, in, 0, ZCHUNK);
+    else if(mode == SPLICE)
+      n = splice(in, 0, out, 0, ZCHUNK, SPLICE_F_MOVE|SPLICE_F_MORE);
+    else if((n = read(in, buf, sizeof(buf))) > 0){
+      for(off = 0; off < n; off += w)
+        if((w = write(out, buf + off, n - off)) < 0)
+          return -1;
+    }
+    if(n == 0)
+      return 0;
+    if(n < 0){
+      if(errno == EINTR)
+        continue;
+      // nothing was moved by the failed call, so switching is safe
+      if(mode != RW && (errno == EINVAL || errno == ENOSYS || errno == EBADF)){
+        mode = RW;
+        continue;
+      }
+      return -1;
+    }
+  }
+}
+
+// Plain tee in user space, for the cases tee(2) can't handle.
+int
+teecopy(int *fds, int nfds)
+{
+  static char buf[65536];
+  ssize_t n, w, off;
+  int i;
+
+  while((n = read(STDIN_FILENO, buf, sizeof(buf))) != 0){
+    if(n < 0){
+      if(errno == EINTR)
+        continue;
+      return -1;
+    }
+    for(i = 0; i < nfds; i++)
+      for(off = 0; off < n; off += w)
+        if((w = write(fds[i], buf + off, n - off)) < 0)
+          return -1;
+  }
+  return 0;
+}
+
+// tee file: stdin -> stdout and file. With pipes on both sides tee(2)
+// duplicates the data into stdout and splice() then moves it into the file.
+int
+ztee(int *fds, int nfds)
+{
+  struct stat si, so;
+  ssize_t n, m;
+  int started = 0;
+
+  if(nfds != 2 || fstat(STDIN_FILENO, &si) < 0 || fstat(STDOUT_FILENO, &so) < 0 ||
+     !S_ISFIFO(si.st_mode) || !S_ISFIFO(so.st_mode))
+    return teecopy(fds, nfds);
+  for(;;){
+    n = tee(STDIN_FILENO, STDOUT_FILENO, ZCHUNK, 0);
+    if(n == 0)
+      return 0;
+    if(n < 0){
+      if(errno == EINTR)
+        continue;
+      if(!started && errno == EINVAL)
+        return teecopy(fds, nfds);
+      return -1;
+    }
+    started = 1;
+    // consume exactly the n bytes that went to stdout
+    for(; n > 0; n -= m){
+      m = splice(STDIN_FILENO, 0, fds[1], 0, n, SPLICE_F_MOVE|SPLICE_F_MORE);
+      if(m <= 0){
+        if(m < 0 && errno == EINTR){
+          m = 0;
+          continue;
+        }
+        return -1;
+      }
+    }
+  }
+}
+
+// cat and tee without options are pure data movement stages
+int
+databuiltin(struct execcmd *ecmd)
+{
+  int i;
+
+  if(strcmp(ecmd->argv[0], "cat") != 0 && strcmp(ecmd->argv[0], "tee") != 0)
+    return 0;
+  for(i = 1; ecmd->argv[i]; i++)
+    if(ecmd->argv[i][0] == '-' && ecmd->argv[i][1] != 0)
+      return 0;  // options: leave it to the real program
+  return 1;
+}
+
+// Runs in the child after runcmd has done the redirections.
+int
+rundatabuiltin(struct execcmd *ecmd)
+{
+  int i, fd, n, ret = 0;
+  int *fds;
+
+  if(strcmp(ecmd->argv[0], "cat") == 0){
+    if(ecmd->argv[1] == 0)
+      return zcopy(STDIN_FILENO, STDOUT_FILENO) < 0;
+    for(i = 1; ecmd->argv[i]; i++){
+      if(strcmp(ecmd->argv[i], "-") == 0)
+        fd = STDIN_FILENO;
+      else if((fd = open(ecmd->argv[i], O_RDONLY)) < 0){
+        fprintf(stderr, "cat: %s: %s\n", ecmd->argv[i], strerror(errno));
+        ret = 1;
+        continue;
+      }
+      if(zcopy(fd, STDOUT_FILENO) < 0){
+        fprintf(stderr, "cat: %s: %s\n", ecmd->argv[i], strerror(errno));
+        ret = 1;
+      }
+      if(fd != STDIN_FILENO)
+        close(fd);
+    }
+    return ret;
+  }
+
+  // tee: fds[0] is stdout, then the files
+  for(n = 1; ecmd->argv[n]; n++)
+    ;
+  fds = malloc(n * sizeof(int));
+  assert(fds);
+  fds[0] = STDOUT_FILENO;
+  // like tee: a file that can't be opened is reported and skipped
+  for(i = 1, n = 1; ecmd->argv[i]; i++){
+    if((fds[n] = open(ecmd->argv[i], O_WRONLY|O_CREAT|O_TRUNC, 0666)) < 0){
+      fprintf(stderr, "tee: %s: %s\n", ecmd->argv[i], strerror(errno));
+      ret = 1;
+      continue;
+    }
+    n++;
+  }
+  if(n == 1)
+    return (zcopy(STDIN_FILENO, STDOUT_FILENO) < 0) | ret;
+  return (ztee(fds, n) < 0) | ret;
+}
+
+
+/*****************************************************************************/
+/*      Per-command accounting: the time prefix and the -L log               */
+/*****************************************************************************/
+
+// Every started stage is recorded with its start time while timing or
+// logging; the record is completed by whoever reaps the pid (foreground
+// wait, SIGCHLD queue or wait builtin) with the rusage from wait4.
+
+struct proc {
+  pid_t pid;
+  struct timespec start, end;
+  struct rusage ru;
+  int status;
+  int done;
+  char *cmd;             // argv joined, for the log and the time report
+  struct proc *next;
+};
+
+struct proc *procs;
+int timing;              // set by the time prefix for the current pipeline
+
+int
+exitstatus(int st)
+{
+  return WIFEXITED(st) ? WEXITSTATUS(st) : 128 + WTERMSIG(st);
+}
+
+double
+tsdiff(struct timespec *a, struct timespec *b)
+{
+  return (b->tv_sec - a->tv_sec) + (b->tv_nsec - a->tv_nsec) / 1e9;
+}
+
+double
+tvsecs(struct timeval *tv)
+{
+  return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+void
+procstart(pid_t pid, struct cmd *cmd)
+{
+  struct execcmd *ecmd;
+  struct proc *p;
+  size_t len = 1;
+  int i;
+
+  if(pid <= 0 || (logfd < 0 && !timing))
+    return;
+  while(cmd->type == '<' || cmd->type == '>')
+    cmd = ((struct redircmd*)cmd)->cmd;
+  ecmd = (struct execcmd*)cmd;
+  p = calloc(1, sizeof(*p));
+  assert(p);
+  p->pid = pid;
+  clock_gettime(CLOCK_MONOTONIC, &p->start);
+  for(i = 0; cmd->type == ' ' && ecmd->argv[i]; i++)
+    len += strlen(ecmd->argv[i]) + 1;
+  p->cmd = calloc(1, len);
+  assert(p->cmd);
+  for(i = 0; cmd->type == ' ' && ecmd->argv[i]; i++){
+    if(i)
+      strcat(p->cmd, " ");
+    strcat(p->cmd, ecmd->argv[i]);
+  }
+  p->next = procs;
+  procs = p;
+}
+
+// JSON string body: only " and \ and control characters need escaping
+void
+logstr(FILE *f, char *s)
+{
+  for(; *s; s++){
+    if(*s == '"' || *s == '\\')
+      fprintf(f, "\\%c", *s);
+    else if((unsigned char)*s < 0x20)
+      fprintf(f, "\\u%04x", *s);
+    else
+      fputc(*s, f);
+  }
+}
+
+void
+logproc(struct proc *p)
+{
+  char *line = 0;
+  size_t len = 0;
+  struct timespec now;
+  FILE *f;
+
+  if(logfd < 0)
+    return;
+  clock_gettime(CLOCK_REALTIME, &now);
+  if((f = open_memstream(&line, &len)) == 0)
+    return;
+  fprintf(f, "{\"time\":%ld.%03ld,\"pid\":%d,\"cmd\":\"", (long)now.tv_sec, now.tv_nsec / 1000000, p->pid);
+  logstr(f, p->cmd);
+  fprintf(f, "\",\"status\":%d,\"real\":%.6f,\"user\":%.6f,\"sys\":%.6f,\"maxrss_kb\":%ld}\n",
+          p->status, tsdiff(&p->start, &p->end), tvsecs(&p->ru.ru_utime),
+          tvsecs(&p->ru.ru_stime), p->ru.ru_maxrss);
+  fclose(f);
+  // O_APPEND and a single write: lines from concurrent shells don't mix
+  if(write(logfd, line, len) < 0)
+    perror("log");
+  free(line);
+}
+
+// Complete the record of pid. With keep the record stays for the caller
+// (the time report) and is freed by procfree.
+struct proc*
+procdone(pid_t pid, int st, struct rusage *ru, int keep)
+{
+  struct proc **pp, *p;
+
+  for(pp = &procs; (p = *pp); pp = &p->next)
+    if(p->pid == pid && !p->done)
+      break;
+  if(p == 0)
+    return 0;
+  clock_gettime(CLOCK_MONOTONIC, &p->end);
+  if(ru)
+    p->ru = *ru;
+  p->status = exitstatus(st);
+  p->done = 1;
+  logproc(p);
+  if(keep)
+    return p;
+  *pp = p->next;
+  free(p->cmd);
+  free(p);
+  return 0;
+}
+
+void
+procfree(struct proc *p)
+{
+  struct proc **pp;
+
+  for(pp = &procs; *pp; pp = &(*pp)->next){
+    if(*pp == p){
+      *pp = p->next;
+      break;
+    }
+  }
+  free(p->cmd);
+  free(p);
+}
+
+// Relay for a timed pipe: moves in -> out with splice and counts the bytes
+// in *count, which lives in shared memory.
+void
+relay(int in, int out, long long *count)
+{
+  static char buf[65536];
+  ssize_t n, w, off;
+  int usesplice = 1;
+
+  for(;;){
+    if(usesplice)
+      n = splice(in, 0, out, 0, ZCHUNK, SPLICE_F_MOVE);
+    else if((n = read(in, buf, sizeof(buf))) > 0){
+      for(off = 0; off < n; off += w)
+        if((w = write(out, buf + off, n - off)) < 0)
+          exit(1);
+    }
+    if(n == 0)
+      exit(0);
+    if(n < 0){
+      if(errno == EINTR)
+        continue;
+      if(usesplice && errno == EINVAL){
+        usesplice = 0;
+        continue;
+      }
+      exit(1);
+    }
+    *count += n;
+  }
+}
+
+
+/*****************************************************************************/
+/*      Run a | b | c ... : all stages are children of the calling process   */
+/*****************************************************************************/
+
+// Flattens a | b | c ... into *stagep (malloc-ed), returns the count.
+int
+pipestages(struct cmd *cmd, struct cmd ***stagep)
+{
+  struct cmd **stage = 0;
+  int n = 0, cap = 0;
+
+  // pipecmd is right-recursive: left is always a single stage
+  for(;;){
+    if(n == cap){
+      cap = cap ? 2*cap : 8;
+      stage = realloc(stage, cap * sizeof(*stage));
+      assert(stage);
+    }
+    if(cmd->type != '|'){
+      stage[n++] = cmd;
+      break;
+    }
+    stage[n++] = ((struct pipecmd*)cmd)->left;
+    cmd = ((struct pipecmd*)cmd)->right;
+  }
+  *stagep = stage;
+  return n;
+}
+
+// Starts every stage of cmd (a single command is a 1-stage pipeline) and
+// returns the number of stages, with their pids in *pidsp (-1 if a stage
+// could not be started). Returns 0 if nothing was started. If counts is
+// given, every pipe gets a relay in between that counts its bytes into
+// counts[i]; the relay pids go to *relaysp.
+int
+startpipeline(struct cmd *cmd, int **pidsp, long long *counts, int **relaysp)
+{
+  struct cmd **stage;
+  int (*pd)[2] = 0;
+  int *pids = 0, *relays = 0;
+  int n, np, i, j;
+
+  n = pipestages(cmd, &stage);
+
+  // stage i writes pd[i][1]; stage i+1 reads pd[i][0], or with relays
+  // pd[n-1+i][0], and relay i moves pd[i][0] to pd[n-1+i][1]
+  np = counts ? 2*(n-1) : n-1;
+  pd = malloc((np > 0 ? np : 1) * sizeof(*pd));
+  pids = malloc(n * sizeof(*pids));
+  assert(pd && pids);
+  // O_CLOEXEC: the stages only keep the ends that are dup2-ed to 0/1
+  for(i = 0; i < np; i++){
+    if(pipe2(pd[i], O_CLOEXEC) < 0){
+      fprintf(stderr, "pipe not done\n");
+      for(j = 0; j < i; j++){
+        close(pd[j][0]);
+        close(pd[j][1]);
+      }
+      free(stage); free(pd); free(pids);
+      return 0;
+    }
+    if(pipesize > 0)
+      fcntl(pd[i][0], F_SETPIPE_SZ, pipesize);
+  }
+#define STAGEIN(i)  (counts ? pd[n-2+(i)][0] : pd[(i)-1][0])
+#define STAGEOUT(i) (pd[i][1])
+
+  if(counts){
+    relays = malloc((n > 1 ? n-1 : 1) * sizeof(*relays));
+    assert(relays);
+    for(i = 0; i < n-1; i++){
+      counts[i] = 0;
+      if((relays[i] = fork1()) == 0){
+        for(j = 0; j < np; j++){
+          if(pd[j][0] != pd[i][0])
+            close(pd[j][0]);
+          if(pd[j][1] != pd[n-1+i][1])
+            close(pd[j][1]);
+        }
+        relay(pd[i][0], pd[n-1+i][1], &counts[i]);
+      }
+      close(pd[i][0]);
+      close(pd[n-1+i][1]);
+    }
+    *relaysp = relays;
+  }
+
+  for(i = 0; i < n; i++){
+    pids[i] = spawncmd(stage[i], i > 0 ? STAGEIN(i) : -1, i < n-1 ? STAGEOUT(i) : -1);
+    if(pids[i] == -2 && (pids[i] = fork1()) == 0){
+      if(i > 0)
+        dup2(STAGEIN(i), STDIN_FILENO);
+      if(i < n-1)
+        dup2(STAGEOUT(i), STDOUT_FILENO);
+      // to paidi krataei mono ta stdin/stdout tou, alliws o reader den pairnei EOF
+      for(j = 0; j < np; j++){
+        close(pd[j][0]);
+        close(pd[j][1]);
+      }
+      runcmd(stage[i]);
+    }
+    procstart(pids[i], stage[i]);
+    // o pateras kleinei amesws oti den xreiazetai pia
+    if(i > 0)
+      close(STAGEIN(i));
+    if(i < n-1)
+      close(STAGEOUT(i));
+  }
+#undef STAGEIN
+#undef STAGEOUT
+
+  free(stage);
+  free(pd);
+  *pidsp = pids;
+  return n;
+}
+
+// Wait for all n pids, return the exit status of the last one, like sh.
+// Other children reaped meanwhile (background jobs) are passed on. With
+// stats, the accounting records of the pids are kept in stats[i].
+int
+waitpids(int *pids, int n, struct proc **stats)
+{
+  struct rusage ru;
+  int i, st, left = 0, ret = 1;
+  pid_t pid;
+
+  for(i = 0; i < n; i++)
+    if(pids[i] > 0)
+      left++;
+  while(left > 0 && (pid = wait4(-1, &st, 0, &ru)) > 0){
+    for(i = 0; i < n && pids[i] != pid; i++)
+      ;
+    if(i == n){
+      reaped(pid, st, &ru);
+      continue;
+    }
+    if(i == n-1)
+      ret = exitstatus(st);
+    if(stats)
+      stats[i] = procdone(pid, st, &ru, 1);
+    else
+      procdone(pid, st, &ru, 0);
+    left--;
+  }
+  return ret;
+}
+
+int
+runpipeline(struct cmd *cmd)
+{
+  int *pids, n, ret;
+
+  if(zygotefd >= 0 && (ret = zrunpipeline(cmd)) >= 0)
+    return ret;
+  if((n = startpipeline(cmd, &pids, 0, 0)) == 0)
+    return 1;
+  ret = waitpids(pids, n, 0);
+  free(pids);
+  return ret;
+}
+
+// time a | b | ...: wall, user, sys and max RSS per stage and in total,
+// and the bytes that went through each pipe.
+int
+timepipeline(struct cmd *cmd)
+{
+  struct proc **stats;
+  struct timespec t0, t1;
+  long long *counts;
+  int *pids, *relays = 0, n, i, ret;
+  double user = 0, sys = 0;
+  long maxrss = 0;
+  size_t size;
+  struct cmd *c;
+
+  for(n = 1, c = cmd; c->type == '|'; c = ((struct pipecmd*)c)->right)
+    n++;
+  // shared with the relays, one counter per pipe
+  size = n * sizeof(long long);
+  counts = mmap(0, size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+  if(counts == MAP_FAILED)
+    return runpipeline(cmd);
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  timing = 1;
+  n = startpipeline(cmd, &pids, counts, &relays);
+  timing = 0;
+  if(n == 0){
+    munmap(counts, size);
+    return 1;
+  }
+  // stages and relays in one wait: waitpids reaps any child, so waiting
+  // for the relays separately would block on unrelated background jobs
+  if(relays){
+    pids = realloc(pids, (2*n-1) * sizeof(*pids));
+    assert(pids);
+    memcpy(pids + n, relays, (n-1) * sizeof(*pids));
+  }
+  stats = calloc(2*n-1, sizeof(*stats));
+  assert(stats);
+  waitpids(pids, relays ? 2*n-1 : n, stats);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  // the relays come after the stages in pids: the status is the last stage's
+  ret = stats[n-1] ? stats[n-1]->status : 1;
+
+  for(i = 0; i < n; i++){
+    if(stats[i] == 0){
+      fprintf(stderr, "%d: not started\n", i+1);
+      continue;
+    }
+    fprintf(stderr, "%d: real %.3fs user %.3fs sys %.3fs maxrss %ldKB status %d\t%s\n",
+            i+1, tsdiff(&stats[i]->start, &stats[i]->end),
+            tvsecs(&stats[i]->ru.ru_utime), tvsecs(&stats[i]->ru.ru_stime),
+            stats[i]->ru.ru_maxrss, stats[i]->status, stats[i]->cmd);
+    if(i < n-1)
+      fprintf(stderr, "   | %lld bytes\n", counts[i]);
+    user += tvsecs(&stats[i]->ru.ru_utime);
+    sys += tvsecs(&stats[i]->ru.ru_stime);
+    if(stats[i]->ru.ru_maxrss > maxrss)
+      maxrss = stats[i]->ru.ru_maxrss;
+    procfree(stats[i]);
+  }
+  fprintf(stderr, "total: real %.3fs user %.3fs sys %.3fs maxrss %ldKB\n",
+          tsdiff(&t0, &t1), user, sys, maxrss);
+
+  munmap(counts, size);
+  free(stats);
+  free(relays);
+  free(pids);
+  return ret;
+}
+
+// If the first stage of cmd starts with word, drop it and return 1.
+int
+stripprefix(struct cmd *cmd, char *word)
+{
+  struct execcmd *ecmd;
+
+  while(cmd->type == '|')
+    cmd = ((struct pipecmd*)cmd)->left;
+  while(cmd->type == '<' || cmd->type == '>')
+    cmd = ((struct redircmd*)cmd)->cmd;
+  ecmd = (struct execcmd*)cmd;
+  if(cmd->type != ' ' || ecmd->argv[0] == 0 || strcmp(ecmd->argv[0], word) != 0)
+    return 0;
+  ecmd->argv++;
+  ecmd->eargv++;
+  ecmd->argc--;
+  ecmd->maxargs--;
+  return 1;
+}
+
+
+/*****************************************************************************/
+/*      Fork server (sh -Z)                                                  */
+/*****************************************************************************/
+
+// A helper forked at startup, while the shell is still small, creates the
+// processes instead of the shell. Per stage it gets one request over a
+// SOCK_SEQPACKET socket: the argv and redirections of the execcmd, plus
+// stdin, stdout, stderr and the shell's cwd as SCM_RIGHTS fds. It answers
+// ZSTARTED with the pid right away and ZEXITED with status and rusage when
+// the process ends. Only foreground pipelines of plain commands use it.
+
+#define ZMAXMSG 65536
+#define ZNFDS 4          // stdin, stdout, stderr, cwd
+
+enum { ZSTARTED, ZEXITED };
+
+struct zreq {
+  int argc, nredir;
+  // then nredir x (fd, flags), then path, argv[], redir files, 0-terminated
+};
+
+struct zrep {
+  int kind;
+  pid_t pid;             // -1 if fork failed
+  int status;
+  struct rusage ru;
+};
+
+int
+zsendfds(int sock, void *buf, size_t len, int *fds, int nfds)
+{
+  struct iovec iov = { buf, len };
+  struct msghdr msg;
+  struct cmsghdr *cm;
+  char cbuf[CMSG_SPACE(ZNFDS * sizeof(int))];
+
+  memset(&msg, 0, sizeof(msg));
+  memset(cbuf, 0, sizeof(cbuf));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = cbuf;
+  msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+  cm = CMSG_FIRSTHDR(&msg);
+  cm->cmsg_level = SOL_SOCKET;
+  cm->cmsg_type = SCM_RIGHTS;
+  cm->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+  memcpy(CMSG_DATA(cm), fds, nfds * sizeof(int));
+  return sendmsg(sock, &msg, MSG_NOSIGNAL) == (ssize_t)len ? 0 : -1;
+}
+
+// Child side of a request: set up fds, cwd and redirections, then exec.
+void
+zexec(char *buf, int *fds)
+{
+  struct zreq *rq = (struct zreq*)buf;
+  int *redir = (int*)(rq + 1);
+  char *p = (char*)(redir + 2*rq->nredir), *path, **argv;
+  int i, fd;
+
+  sigprocmask(SIG_SETMASK, &origmask, 0);
+  for(i = 0; i < 3; i++)
+    dup2(fds[i], i);
+  if(fchdir(fds[3]) < 0)
+    _exit(1);
+  path = p;
+  p += strlen(p) + 1;
+  argv = malloc((rq->argc + 1) * sizeof(char*));
+  assert(argv);
+  for(i = 0; i < rq->argc; i++){
+    argv[i] = p;
+    p += strlen(p) + 1;
+  }
+  argv[i] = 0;
+  // outer redirections first, same order as runcmd
+  for(i = 0; i < rq->nredir; i++){
+    if((fd = open(p, redir[2*i+1], 0777)) < 0){
+      fprintf(stderr, "The opening of %s not done\n", p);
+      _exit(0);
+    }
+    dup2(fd, redir[2*i]);
+    close(fd);
+    p += strlen(p) + 1;
+  }
+  if(*path)
+    execv(path, argv);
+  else
+    execvp(argv[0], argv);
+  fprintf(stderr, "cannot run %s: %s\n", argv[0], strerror(errno));
+  _exit(127);
+}
+
+void
+zygote(int sock)
+{
+  static char buf[ZMAXMSG];
+  char cbuf[CMSG_SPACE(ZNFDS * sizeof(int))];
+  struct signalfd_siginfo si;
+  struct pollfd pfd[2];
+  struct cmsghdr *cm;
+  struct msghdr msg;
+  struct iovec iov;
+  struct zrep rep;
+  int sfd, fds[ZNFDS], nfds, i, st;
+  ssize_t n;
+  pid_t pid;
+
+  // it must not keep the shell's stdin/stdout (pipes, ttys) open
+  if((i = open("/dev/null", O_RDWR)) >= 0){
+    dup2(i, STDIN_FILENO);
+    dup2(i, STDOUT_FILENO);
+    close(i);
+  }
+  sfd = signalfd(-1, &chldmask, SFD_NONBLOCK|SFD_CLOEXEC);  // SIGCHLD is already blocked
+  pfd[0].fd = sock;
+  pfd[0].events = POLLIN;
+  pfd[1].fd = sfd;
+  pfd[1].events = POLLIN;
+  for(;;){
+    if(poll(pfd, 2, -1) < 0){
+      if(errno == EINTR)
+        continue;
+      _exit(1);
+    }
+    if(pfd[1].revents & POLLIN){
+      // only a wakeup, the reaping is below
+      while(read(sfd, &si, sizeof(si)) == sizeof(si))
+        continue;
+      memset(&rep, 0, sizeof(rep));
+      rep.kind = ZEXITED;
+      while((pid = wait4(-1, &st, WNOHANG, &rep.ru)) > 0){
+        rep.pid = pid;
+        rep.status = st;
+        if(send(sock, &rep, sizeof(rep), 0) < 0)
+          _exit(1);
+      }
+    }
+    if(pfd[0].revents & (POLLIN|POLLHUP)){
+      iov.iov_base = buf;
+      iov.iov_len = sizeof(buf);
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = cbuf;
+      msg.msg_controllen = sizeof(cbuf);
+      if((n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC)) <= 0)
+        _exit(0);  // the shell has exited
+      nfds = 0;
+      cm = CMSG_FIRSTHDR(&msg);
+      if(cm && cm->cmsg_type == SCM_RIGHTS){
+        nfds = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        memcpy(fds, CMSG_DATA(cm), nfds * sizeof(int));
+      }
+      memset(&rep, 0, sizeof(rep));
+      rep.kind = ZSTARTED;
+      rep.pid = -1;
+      if(nfds == ZNFDS && (size_t)n >= sizeof(struct zreq)){
+        buf[n < ZMAXMSG ? n : ZMAXMSG-1] = 0;
+        if((rep.pid = fork()) == 0)
+          zexec(buf, fds);
+      }
+      for(i = 0; i < nfds; i++)
+        close(fds[i]);
+      if(send(sock, &rep, sizeof(rep), 0) < 0)
+        _exit(1);
+    }
+  }
+}
+
+// Start the fork server; the shell keeps one end of the socket.
+void
+startzygote(void)
+{
+  int sv[2];
+  pid_t pid;
+
+  if(socketpair(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC, 0, sv) < 0){
+    perror("socketpair");
+    return;
+  }
+  if((pid = fork()) < 0){
+    perror("fork");
+    close(sv[0]);
+    close(sv[1]);
+    return;
+  }
+  if(pid == 0){
+    close(sv[0]);
+    zygote(sv[1]);
+  }
+  close(sv[1]);
+  zygotefd = sv[0];
+}
+
+// Pack the execcmd at the bottom of cmd into buf; returns the length, or
+// -1 if cmd is not a plain command or does not fit in one message.
+int
+zpack(struct cmd *cmd, char *buf)
+{
+  struct zreq *rq = (struct zreq*)buf;
+  struct redircmd *r[64];
+  struct execcmd *ecmd;
+  int nr = 0, i, *redir;
+  size_t len;
+  char *p;
+
+  while(cmd->type == '<' || cmd->type == '>'){
+    if(nr == 64)
+      return -1;
+    r[nr++] = (struct redircmd*)cmd;
+    cmd = r[nr-1]->cmd;
+  }
+  ecmd = (struct execcmd*)cmd;
+  if(cmd->type != ' ' || ecmd->argv[0] == 0 || databuiltin(ecmd))
+    return -1;
+  rq->argc = ecmd->argc;
+  rq->nredir = nr;
+  redir = (int*)(rq + 1);
+  p = (char*)(redir + 2*nr);
+  len = p - buf;
+#define ZPUT(str) do { size_t l = strlen(str) + 1; \
+    if(len + l > ZMAXMSG) return -1; \
+    memcpy(buf + len, str, l); len += l; } while(0)
+  ZPUT(ecmd->path ? ecmd->path : "");
+  for(i = 0; i < ecmd->argc; i++)
+    ZPUT(ecmd->argv[i]);
+  for(i = 0; i < nr; i++){
+    redir[2*i] = r[i]->fd;
+    redir[2*i+1] = r[i]->flags;
+    ZPUT(r[i]->file);
+  }
+#undef ZPUT
+  return len;
+}
+
+// Exit reports that arrive while we wait for a ZSTARTED are kept here.
+struct zrep *zstash;
+int nzstash, zstashcap;
+
+int
+zrecv(struct zrep *rep)
+{
+  ssize_t n;
+
+  while((n = recv(zygotefd, rep, sizeof(*rep), 0)) < 0 && errno == EINTR)
+    ;
+  if(n != sizeof(*rep)){
+    rep->kind = -1;
+    return -1;
+  }
+  return 0;
+}
+
+// Run a foreground pipeline through the fork server. Returns its status,
+// or -1 (nothing started) if some stage can't go through the server.
+int
+zrunpipeline(struct cmd *cmd)
+{
+  static char buf[ZMAXMSG];
+  struct cmd **stage;
+  struct zrep rep;
+  int (*pd)[2];
+  int *pids, n, i, j, len, left = 0, ret = 1, fds[ZNFDS], cwd;
+
+  n = pipestages(cmd, &stage);
+  for(i = 0; i < n; i++){
+    hashcmd(stage[i]);
+    if(zpack(stage[i], buf) < 0){
+      free(stage);
+      return -1;
+    }
+  }
+  if((cwd = open(".", O_RDONLY|O_DIRECTORY|O_CLOEXEC)) < 0){
+    free(stage);
+    return -1;
+  }
+  pd = malloc((n > 1 ? n-1 : 1) * sizeof(*pd));
+  pids = malloc(n * sizeof(*pids));
+  assert(pd && pids);
+  for(i = 0; i < n-1; i++){
+    if(pipe2(pd[i], O_CLOEXEC) < 0){
+      fprintf(stderr, "pipe not done\n");
+      for(j = 0; j < i; j++){
+        close(pd[j][0]);
+        close(pd[j][1]);
+      }
+      close(cwd);
+      free(stage); free(pd); free(pids);
+      return 1;
+    }
+    if(pipesize > 0)
+      fcntl(pd[i][0], F_SETPIPE_SZ, pipesize);
+  }
+
+  for(i = 0; i < n; i++){
+    len = zpack(stage[i], buf);
+    fds[0] = i > 0 ? pd[i-1][0] : STDIN_FILENO;
+    fds[1] = i < n-1 ? pd[i][1] : STDOUT_FILENO;
+    fds[2] = STDERR_FILENO;
+    fds[3] = cwd;
+    pids[i] = -1;
+    rep.kind = -1;
+    if(zsendfds(zygotefd, buf, len, fds, ZNFDS) == 0){
+      while(zrecv(&rep) == 0 && rep.kind != ZSTARTED){
+        if(nzstash == zstashcap){
+          zstashcap = zstashcap ? 2*zstashcap : 8;
+          zstash = realloc(zstash, zstashcap * sizeof(*zstash));
+          assert(zstash);
+        }
+        zstash[nzstash++] = rep;
+      }
+    }
+    if(rep.kind != ZSTARTED){
+      // the fork server is gone: stop using it for this and later lines
+      close(zygotefd);
+      zygotefd = -1;
+      nzstash = 0;
+      break;
+    }
+    pids[i] = rep.pid;  // -1 if its fork failed
+    if(pids[i] > 0){
+      procstart(pids[i], stage[i]);
+      left++;
+    }
+    // o pateras kleinei amesws oti den xreiazetai pia
+    if(i > 0)
+      close(pd[i-1][0]);
+    if(i < n-1)
+      close(pd[i][1]);
+  }
+  close(cwd);
+  if(i < n){
+    // stages i.. were not started, close what they would have used
+    for(j = i; j < n; j++){
+      if(j > 0)
+        close(pd[j-1][0]);
+      if(j < n-1)
+        close(pd[j][1]);
+    }
+    if(i == 0){
+      // nothing started: the caller runs the line the local way
+      free(stage);
+      free(pd);
+      free(pids);
+      return -1;
+    }
+    fprintf(stderr, "fork server gone\n");
+    left = 0;
+  }
+
+  while(left > 0){
+    if(nzstash > 0)
+      rep = zstash[--nzstash];
+    else if(zrecv(&rep) < 0){
+      fprintf(stderr, "fork server gone\n");
+      close(zygotefd);
+      zygotefd = -1;
+      break;
+    }
+    for(i = 0; i < n && pids[i] != rep.pid; i++)
+      ;
+    if(rep.kind != ZEXITED || i == n)
+      continue;
+    if(i == n-1)
+      ret = exitstatus(rep.status);
+    procdone(rep.pid, rep.status, &rep.ru, 0);
+    pids[i] = -1;
+    left--;
+  }
+
+  free(stage);
+  free(pd);
+  free(pids);
+  return ret;
+}
 
 
 /*****************************************************************************/
-/*      Run command.  Never returns. You need to implement this function     */
+/*      Background jobs, ; lists and the wait builtin                        */
 /*****************************************************************************/
 
+// SIGCHLD is blocked while the shell runs anything in the foreground, so
+// foreground waitpid()s never race with the handler. It is unblocked while
+// the shell waits for input; the handler then reaps finished background
+// stages and queues them for reapjobs().
+
+struct job {
+  int id;
+  int n, live;           // stages, stages still running
+  int *pids;             // -1 once reaped
+  int status;            // exit status of the last stage
+  char *line;            // for the Done message
+  struct job *next;
+};
+
+struct job *jobs;
+int nextjob = 1;
+char *curline;           // line being run, copied into new jobs
+
+#define NPENDING 64
+volatile sig_atomic_t npending;
+pid_t pendpid[NPENDING];
+int pendst[NPENDING];
+struct rusage pendru[NPENDING];
+
 void
-runcmd(struct cmd *cmd)
+sigchld(int sig)
 {
-  int pd[2];                                       
-  int temp_dir;
-  int pid;                                    
-  struct execcmd *ecmd;
-  struct pipecmd *pcmd;
-  struct redircmd *rcmd;
+  int saved = errno;
+  pid_t pid;
 
-  if(cmd == 0)
-    exit(0);
-  
-  switch(cmd->type){
-  default:
-    fprintf(stderr, "unknown runcmd\n");
-    exit(-1);
+  (void)sig;
+  while(npending < NPENDING &&
+        (pid = wait4(-1, &pendst[npending], WNOHANG, &pendru[npending])) > 0){
+    pendpid[npending] = pid;
+    npending++;
+  }
+  errno = saved;
+}
 
-  case ' ':                                       
-    ecmd = (struct execcmd*)cmd;
-    if(ecmd->argv[0] == 0)
-      exit(0);
-    //fprintf(stderr, "exec not implemented\n");
-    // Your code here ...
-    //aples entoles na ektelestoun . boh8eia : exec,man 3 exec
-    execvp(ecmd->argv[0], ecmd->argv); //execvp(const char *file, char *const argv[]);
-    //.
-    break;
+// Every reaped child that isn't a foreground stage ends up here.
+void
+reaped(pid_t pid, int st, struct rusage *ru)
+{
+  struct job *j;
+  int i;
 
-  case '>':                                       
-  case '<':                                       
-    rcmd = (struct redircmd*)cmd;
-    //fprintf(stderr, "temp_dir not implemented\n");
-    // Your code here ...
-    //na ginei anakateu8ynsh . boh8eia : open,close,dup
-    //anoigw proswrino directory me prosbash se ola
-    temp_dir = open(rcmd->file, rcmd->flags, 0777);
+  procdone(pid, st, ru, 0);
 
-    if (temp_dir < 0)
-    {
-      fprintf(stderr, "The opening of %s not done\n", rcmd->file);
-      exit(0);
-    }
-    
-    //duplication
-    if (dup2(temp_dir, rcmd->fd) < 0)                 
-    {
-      fprintf(stderr, "dup not done\n");
-      exit(0);
+  for(j = jobs; j; j = j->next){
+    for(i = 0; i < j->n; i++){
+      if(j->pids[i] == pid){
+        j->pids[i] = -1;
+        j->live--;
+        if(i == j->n-1)
+          j->status = exitstatus(st);
+        return;
+      }
     }
+  }
+}
 
-    close(temp_dir);
-    //.
-    runcmd(rcmd->cmd);
-    break;
+// Called with SIGCHLD blocked: collect what the handler queued, reap any
+// stragglers it had no room for, and drop finished jobs.
+void
+reapjobs(int report)
+{
+  struct job **jp, *j;
+  struct rusage ru;
+  pid_t pid;
+  int i, st;
 
-  case '|':                                         
-    pcmd = (struct pipecmd*)cmd;
-    
-    // Your code here ...
-    //dioxeteush . boh8eia : fork,pipe,close,dup
+  for(i = 0; i < npending; i++)
+    reaped(pendpid[i], pendst[i], &pendru[i]);
+  npending = 0;
+  while(jobs && (pid = wait4(-1, &st, WNOHANG, &ru)) > 0)
+    reaped(pid, st, &ru);
 
-    if (pipe(pd) < 0)
-    {
-      fprintf(stderr, "pipe not done\n");
-      exit(0);
+  for(jp = &jobs; (j = *jp); ){
+    if(j->live > 0){
+      jp = &j->next;
+      continue;
     }
+    if(report)
+      fprintf(stderr, "[%d] Done (%d)\t%s\n", j->id, j->status, j->line);
+    *jp = j->next;
+    free(j->pids);
+    free(j->line);
+    free(j);
+  }
+  if(jobs == 0)
+    nextjob = 1;
+}
 
-    pid = fork();
+void
+addjob(int *pids, int n)
+{
+  struct job *j, **jp;
+  int i;
 
-    if ( pid < 0)
-    {
-        fprintf(stderr, "fork not done\n");
-        exit(0);
-    }
+  j = malloc(sizeof(*j));
+  assert(j);
+  j->id = nextjob++;
+  j->n = n;
+  j->pids = pids;
+  j->status = 0;
+  j->live = 0;
+  for(i = 0; i < n; i++)
+    if(pids[i] > 0)
+      j->live++;
+  j->line = strdup(curline ? curline : "");
+  j->next = 0;
+  for(jp = &jobs; *jp; jp = &(*jp)->next)
+    ;
+  *jp = j;
+  if(isatty(fileno(stdin)))
+    fprintf(stderr, "[%d] %d\n", j->id, pids[n-1]);
+}
 
-    else if (pid == 0) // to paidi thelw na diabazei pros aristera kai na kanei dup
-    {
-      close(pd[0]);
-      dup2(pd[1], STDOUT_FILENO);                    
-      runcmd(pcmd->left);                           
-      close(pd[1]);
+// wait: block until every background job has finished
+int
+waitbuiltin(void)
+{
+  struct rusage ru;
+  struct job *j;
+  int i, st, ret = 0;
+
+  reapjobs(0);
+  for(j = jobs; j; j = j->next){
+    for(i = 0; i < j->n; i++)
+      if(j->pids[i] > 0 && wait4(j->pids[i], &st, 0, &ru) == j->pids[i])
+        reaped(j->pids[i], st, &ru);
+    ret = j->status;
+  }
+  reapjobs(0);
+  return ret;
+}
+
+void
+jobsbuiltin(void)
+{
+  struct job *j;
+
+  reapjobs(0);
+  for(j = jobs; j; j = j->next)
+    printf("[%d] Running\t%s\n", j->id, j->line);
+  fflush(stdout);
+}
+
+int
+isbuiltin(struct cmd *cmd, char *name)
+{
+  struct execcmd *ecmd = (struct execcmd*)cmd;
+
+  return cmd->type == ' ' && ecmd->argv[0] && strcmp(ecmd->argv[0], name) == 0;
+}
+
+// Run a parsed line in the shell process; returns its exit status.
+int
+runline(struct cmd *cmd)
+{
+  struct listcmd *lcmd;
+  struct backcmd *bcmd;
+  int *pids, n;
+  char *p;
+
+  switch(cmd->type){
+  case ';':
+    lcmd = (struct listcmd*)cmd;
+    runline(lcmd->left);
+    return runline(lcmd->right);
+
+  case '&':
+    bcmd = (struct backcmd*)cmd;
+    if((n = startpipeline(bcmd->cmd, &pids, 0, 0)) == 0)
+      return 1;
+    addjob(pids, n);
+    return 0;
+
+  default:
+    if(isbuiltin(cmd, "cd")){
+      // Chdir has no effect on the parent if run in the child.
+      p = ((struct execcmd*)cmd)->argv[1];
+      if(p == 0 && (p = getenv("HOME")) == 0)
+        p = "/";
+      if(chdir(p) < 0){
+        fprintf(stderr, "cannot cd %s\n", p);
+        return 1;
+      }
+      hashcd();
+      return 0;
     }
-      
-    else  //o pateras thelw na diabazei pros deksia kai na kanei dup
-    {
-      close(pd[1]);
-      dup2(pd[0], STDIN_FILENO);                     
-      runcmd(pcmd->right);                          
-      close(pd[0]);
+    if(isbuiltin(cmd, "hash")){
+      hashbuiltin(((struct execcmd*)cmd)->argv);
+      return 0;
     }
-    wait(&pid);
-    //.
-    break;
-  }    
-  exit(0);
+    if(stripprefix(cmd, "bench")){
+      benchcmd(cmd);
+      return 0;
+    }
+    if(isbuiltin(cmd, "wait"))
+      return waitbuiltin();
+    if(isbuiltin(cmd, "jobs")){
+      jobsbuiltin();
+      return 0;
+    }
+    if(stripprefix(cmd, "time"))
+      return timepipeline(cmd);
+    return runpipeline(cmd);
+  }
 }
 
 
-int getcmd(char *buf, int nbuf)
+// Reads a whole line of any length; *buf grows as needed.
+int getcmd(char **buf, size_t *nbuf)
 {
    if (isatty(fileno(stdin)))
     fprintf(stdout, "$ ");
-  memset(buf, 0, nbuf);
-  if(fgets(buf, nbuf, stdin) == 0)
+  if(getline(buf, nbuf, stdin) < 0)
     return -1; // EOF
   return 0;
 }
 
-int main(void)
+// Run one input line in the shell: parse it, then runline.
+// Returns the exit status of the line.
+int
+runbuf(char *buf)
 {
-  static char buf[100];
-  int r;
+  struct cmd *cmd;
 
-  // Read and run input commands.
-  while(getcmd(buf, sizeof(buf)) >= 0){
-    if(buf[0] == 'c' && buf[1] == 'd' && buf[2] == ' '){
-      // Clumsy but will have to do for now.
-      // Chdir has no effect on the parent if run in the child.
-      buf[strlen(buf)-1] = 0;  // chop \n
-      if(chdir(buf+3) < 0)
-        fprintf(stderr, "cannot cd %s\n", buf+3);
-      continue;
+  areset();  // the previous line's parse tree is no longer needed
+  buf[strcspn(buf, "\n")] = 0;
+  // parsecmd writes 0s into buf, keep the text for the job table
+  curline = strcpy(aalloc(strlen(buf)+1), buf);
+  // to parsing ginetai ston shell, wste ta pipelines na ksekinane apo edw
+  if((cmd = parsecmd(buf)) == 0)
+    return 2;
+  return runline(cmd);
+}
+
+
+/*****************************************************************************/
+/*      Batch mode (sh -j N): independent lines, up to N at a time          */
+/*****************************************************************************/
+
+// Each line runs in its own subshell with stdout/stderr in memfds. Outputs
+// are written out in input order as soon as all earlier lines are done,
+// like xargs -P but without interleaving. At most BPENDING finished lines
+// wait (with their memfds open) behind a slower earlier one; then no new
+// line is started until it is done.
+
+#define BPENDING 64
+
+struct bline {
+  int pid;
+  int out, err;          // captured output, -1 once written out
+  int status;
+  int done;
+};
+
+// Write out the captured output of line b and release it.
+void
+bflush(struct bline *b)
+{
+  lseek(b->out, 0, SEEK_SET);
+  zcopy(b->out, STDOUT_FILENO);
+  lseek(b->err, 0, SEEK_SET);
+  zcopy(b->err, STDERR_FILENO);
+  close(b->out);
+  close(b->err);
+  b->out = b->err = -1;
+}
+
+int
+runbatch(int maxjobs)
+{
+  struct bline *lines = 0;
+  char *buf = 0;
+  size_t nbuf = 0;
+  int n = 0, cap = 0, running = 0, flushed = 0, eof = 0;
+  int i, st, pid, failed = -1, out, err;
+
+  while(!eof || running > 0){
+    // start lines until the pool is full
+    while(!eof && running < maxjobs && n - flushed < maxjobs + BPENDING){
+      out = memfd_create("out", MFD_CLOEXEC);
+      err = memfd_create("err", MFD_CLOEXEC);
+      if(out < 0 || err < 0){
+        if(out >= 0)
+          close(out);
+        if(err >= 0)
+          close(err);
+        // out of fds: wait until earlier lines are written out
+        if(running > 0)
+          break;
+        perror("memfd_create");
+        exit(1);
+      }
+      if(getline(&buf, &nbuf, stdin) < 0){
+        close(out);
+        close(err);
+        eof = 1;
+        break;
+      }
+      if(n == cap){
+        cap = cap ? 2*cap : 64;
+        lines = realloc(lines, cap * sizeof(*lines));
+        assert(lines);
+      }
+      lines[n].out = out;
+      lines[n].err = err;
+      lines[n].done = 0;
+      lines[n].status = 0;
+      fflush(stdout);
+      if((pid = fork1()) == 0){
+        // a subshell: it waits for its own children, so keep SIGCHLD blocked
+        sigprocmask(SIG_BLOCK, &chldmask, 0);
+        // the fork server talks to one shell at a time
+        if(zygotefd >= 0){
+          close(zygotefd);
+          zygotefd = -1;
+        }
+        // the script is not input for the commands, as with xargs
+        if((i = open("/dev/null", O_RDONLY)) >= 0){
+          dup2(i, STDIN_FILENO);
+          close(i);
+        }
+        dup2(lines[n].out, STDOUT_FILENO);
+        dup2(lines[n].err, STDERR_FILENO);
+        exit(runbuf(buf));
+      }
+      if(pid < 0){
+        lines[n].done = 1;
+        lines[n].status = 1;
+      } else
+        running++;
+      lines[n].pid = pid;
+      n++;
+    }
+
+    if(running > 0){
+      if((pid = waitpid(-1, &st, 0)) < 0)
+        break;
+      for(i = flushed; i < n; i++){
+        if(lines[i].pid == pid && !lines[i].done){
+          lines[i].done = 1;
+          lines[i].status = exitstatus(st);
+          running--;
+          break;
+        }
+      }
+    }
+    while(flushed < n && lines[flushed].done){
+      if(lines[flushed].status != 0 && failed < 0)
+        failed = flushed;
+      bflush(&lines[flushed]);
+      flushed++;
+    }
+  }
+  while(flushed < n){  // only if waitpid failed
+    bflush(&lines[flushed]);
+    flushed++;
+  }
+
+  st = 0;
+  if(failed >= 0){
+    st = lines[failed].status;
+    fprintf(stderr, "line %d failed with status %d\n", failed+1, st);
+  }
+  free(lines);
+  free(buf);
+  return st;
+}
+
+int main(int argc, char *argv[])
+{
+  char *buf = 0;
+  size_t nbuf = 0;
+  struct sigaction sa;
+  int r, maxjobs = 0, usezygote = 0;
+
+  while((r = getopt(argc, argv, "FP:j:L:Z")) != -1){
+    switch(r){
+    case 'F':
+      usespawn = 0;
+      break;
+    case 'P':
+      pipesize = atoi(optarg);
+      break;
+    case 'j':
+      maxjobs = atoi(optarg);
+      break;
+    case 'L':
+      if((logfd = open(optarg, O_WRONLY|O_CREAT|O_APPEND|O_CLOEXEC, 0666)) < 0){
+        fprintf(stderr, "cannot open %s\n", optarg);
+        exit(1);
+      }
+      break;
+    case 'Z':
+      usezygote = 1;
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-FZ] [-P pipesize] [-j jobs] [-L log] [script]\n", argv[0]);
+      exit(1);
     }
-    if(fork1() == 0)
-      runcmd(parsecmd(buf));
-    wait(&r);
+  }
+  if(optind < argc && freopen(argv[optind], "r", stdin) == 0){
+    fprintf(stderr, "cannot open %s\n", argv[optind]);
+    exit(1);
+  }
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = sigchld;
+  sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGCHLD, &sa, 0);
+  sigemptyset(&chldmask);
+  sigaddset(&chldmask, SIGCHLD);
+  sigprocmask(SIG_BLOCK, &chldmask, &origmask);
+
+  // forked before anything else, so its address space stays minimal
+  if(usezygote)
+    startzygote();
+  if(maxjobs > 0)
+    exit(runbatch(maxjobs));
+
+  // Read and run input commands.
+  for(;;){
+    reapjobs(isatty(fileno(stdin)));
+    // background jobs are only reaped asynchronously while we read
+    sigprocmask(SIG_UNBLOCK, &chldmask, 0);
+    r = getcmd(&buf, &nbuf);
+    sigprocmask(SIG_BLOCK, &chldmask, 0);
+    if(r < 0)
+      break;
+    runbuf(buf);
   }
   exit(0);
 }
@@ -180,38 +1896,120 @@ int fork1(void)
   pid = fork();
   if(pid == -1)
     perror("fork");
+  if(pid == 0){
+    sigprocmask(SIG_SETMASK, &origmask, 0);  // SIGCHLD is only blocked in the shell
+    // drop our copy of the read-ahead, or exit() in the child would seek
+    // the shared stdin offset back and the shell would read lines twice
+    __fpurge(stdin);
+  }
   return pid;
 }
 
+/*****************************************************************************/
+/*      Parse arena: all nodes of one command line, freed all at once        */
+/*****************************************************************************/
+
+struct ablock {
+  struct ablock *next;
+  size_t size, used;
+  char mem[];
+};
+
+struct ablock *afirst, *acur;
+
+void*
+aalloc(size_t n)
+{
+  struct ablock *b, *last = 0;
+  void *p;
+
+  n = (n + 15) & ~(size_t)15;
+  for(b = acur; b; b = b->next){
+    if(b->size - b->used >= n){
+      acur = b;
+      p = b->mem + b->used;
+      b->used += n;
+      return p;
+    }
+    last = b;
+  }
+  b = malloc(sizeof(*b) + (n > ARENABLOCK ? n : ARENABLOCK));
+  assert(b);
+  b->next = 0;
+  b->size = n > ARENABLOCK ? n : ARENABLOCK;
+  b->used = n;
+  if(last)
+    last->next = b;
+  else
+    afirst = b;
+  acur = b;
+  return b->mem;
+}
+
+// Keep the blocks for the next line.
+void
+areset(void)
+{
+  struct ablock *b;
+
+  for(b = afirst; b; b = b->next)
+    b->used = 0;
+  acur = afirst;
+}
+
 struct cmd* execcmd(void)
 {
   struct execcmd *cmd;
 
-  cmd = malloc(sizeof(*cmd));
+  cmd = aalloc(sizeof(*cmd));
   memset(cmd, 0, sizeof(*cmd));
   cmd->type = ' ';
   return (struct cmd*)cmd;
 }
 
-struct cmd* redircmd(struct cmd *subcmd, char *file, int type)
+struct cmd* redircmd(struct cmd *subcmd, char *file, char *efile, int type)
 {
   struct redircmd *cmd;
 
-  cmd = malloc(sizeof(*cmd));
+  cmd = aalloc(sizeof(*cmd));
   memset(cmd, 0, sizeof(*cmd));
   cmd->type = type;
   cmd->cmd = subcmd;
   cmd->file = file;
+  cmd->efile = efile;
   cmd->flags = (type == '<') ?  O_RDONLY : O_WRONLY|O_CREAT|O_TRUNC;
   cmd->fd = (type == '<') ? 0 : 1;
   return (struct cmd*)cmd;
 }
 
+struct cmd* listcmd(struct cmd *left, struct cmd *right)
+{
+  struct listcmd *cmd;
+
+  cmd = aalloc(sizeof(*cmd));
+  memset(cmd, 0, sizeof(*cmd));
+  cmd->type = ';';
+  cmd->left = left;
+  cmd->right = right;
+  return (struct cmd*)cmd;
+}
+
+struct cmd* backcmd(struct cmd *subcmd)
+{
+  struct backcmd *cmd;
+
+  cmd = aalloc(sizeof(*cmd));
+  memset(cmd, 0, sizeof(*cmd));
+  cmd->type = '&';
+  cmd->cmd = subcmd;
+  return (struct cmd*)cmd;
+}
+
 struct cmd* pipecmd(struct cmd *left, struct cmd *right)
 {
   struct pipecmd *cmd;
 
-  cmd = malloc(sizeof(*cmd));
+  cmd = aalloc(sizeof(*cmd));
   memset(cmd, 0, sizeof(*cmd));
   cmd->type = '|';
   cmd->left = left;
@@ -225,7 +2023,8 @@ struct cmd* pipecmd(struct cmd *left, struct cmd *right)
 /*****************************************************************************/
 
 char whitespace[] = " \t\r\n\v";
-char symbols[] = "<|>";
+jmp_buf parseerr;  // syntax errors return here, so a typo doesn't kill the shell
+char symbols[] = "<|>&;";
 
 int gettoken(char **ps, char *es, char **q, char **eq)
 {
@@ -243,6 +2042,8 @@ int gettoken(char **ps, char *es, char **q, char **eq)
     break;
   case '|':
   case '<':
+  case '&':
+  case ';':
     s++;
     break;
   case '>':
@@ -279,16 +2080,40 @@ struct cmd *parseline(char**, char*);
 struct cmd *parsepipe(char**, char*);
 struct cmd *parseexec(char**, char*);
 
-// make a copy of the characters in the input buffer, starting from s through es.
-// null-terminate the copy to make it a string.
-char *mkcopy(char *s, char *es)
+// Tokens are slices of the input line. Their ends are only overwritten with
+// 0 after parsing, since a token can be followed directly by < | >.
+struct cmd* nulterminate(struct cmd *cmd)
 {
-  int n = es - s;
-  char *c = malloc(n+1);
-  assert(c);
-  strncpy(c, s, n);
-  c[n] = 0;
-  return c;
+  struct execcmd *ecmd;
+  struct redircmd *rcmd;
+  struct pipecmd *pcmd;
+  int i;
+
+  if(cmd == 0)
+    return 0;
+  switch(cmd->type){
+  case ' ':
+    ecmd = (struct execcmd*)cmd;
+    for(i = 0; i < ecmd->argc; i++)
+      *ecmd->eargv[i] = 0;
+    break;
+  case '<':
+  case '>':
+    rcmd = (struct redircmd*)cmd;
+    nulterminate(rcmd->cmd);
+    *rcmd->efile = 0;
+    break;
+  case '|':
+  case ';':  // listcmd has the same layout as pipecmd
+    pcmd = (struct pipecmd*)cmd;
+    nulterminate(pcmd->left);
+    nulterminate(pcmd->right);
+    break;
+  case '&':
+    nulterminate(((struct backcmd*)cmd)->cmd);
+    break;
+  }
+  return cmd;
 }
 
 struct cmd* parsecmd(char *s)
@@ -297,19 +2122,31 @@ struct cmd* parsecmd(char *s)
   struct cmd *cmd;
 
   es = s + strlen(s);
+  if(setjmp(parseerr))
+    return 0;
   cmd = parseline(&s, es);
   peek(&s, es, "");
   if(s != es){
     fprintf(stderr, "leftovers: %s\n", s);
-    exit(-1);
+    return 0;
   }
-  return cmd;
+  return nulterminate(cmd);
 }
 
 struct cmd* parseline(char **ps, char *es)
 {
   struct cmd *cmd;
   cmd = parsepipe(ps, es);
+  if(peek(ps, es, "&")){
+    gettoken(ps, es, 0, 0);
+    cmd = backcmd(cmd);
+  }
+  if(peek(ps, es, ";")){
+    gettoken(ps, es, 0, 0);
+    cmd = listcmd(cmd, parseline(ps, es));
+  } else if(cmd->type == '&' && *ps < es && **ps){
+    cmd = listcmd(cmd, parseline(ps, es));  // a & b: & also separates
+  }
   return cmd;
 }
 
@@ -334,47 +2171,63 @@ struct cmd* parseredirs(struct cmd *cmd, char **ps, char *es)
     tok = gettoken(ps, es, 0, 0);
     if(gettoken(ps, es, &q, &eq) != 'a') {
       fprintf(stderr, "missing file for redirection\n");
-      exit(-1);
+      longjmp(parseerr, 1);
     }
     switch(tok){
     case '<':
-      cmd = redircmd(cmd, mkcopy(q, eq), '<');
+      cmd = redircmd(cmd, q, eq, '<');
       break;
     case '>':
-      cmd = redircmd(cmd, mkcopy(q, eq), '>');
+      cmd = redircmd(cmd, q, eq, '>');
       break;
     }
   }
   return cmd;
 }
 
+// Append q..eq to argv, doubling the arrays in the arena when full.
+void addarg(struct execcmd *cmd, char *q, char *eq)
+{
+  char **argv, **eargv;
+
+  if(cmd->argc == cmd->maxargs){
+    cmd->maxargs = cmd->maxargs ? 2*cmd->maxargs : 8;
+    argv = aalloc(cmd->maxargs * sizeof(char*));
+    eargv = aalloc(cmd->maxargs * sizeof(char*));
+    if(cmd->argc){
+      memcpy(argv, cmd->argv, cmd->argc * sizeof(char*));
+      memcpy(eargv, cmd->eargv, cmd->argc * sizeof(char*));
+    }
+    cmd->argv = argv;
+    cmd->eargv = eargv;
+  }
+  cmd->argv[cmd->argc] = q;
+  cmd->eargv[cmd->argc] = eq;
+  cmd->argc++;
+}
+
 struct cmd* parseexec(char **ps, char *es)
 {
   char *q, *eq;
-  int tok, argc;
+  int tok;
   struct execcmd *cmd;
   struct cmd *ret;
 
   ret = execcmd();
   cmd = (struct execcmd*)ret;
 
-  argc = 0;
   ret = parseredirs(ret, ps, es);
-  while(!peek(ps, es, "|")){
+  while(!peek(ps, es, "|&;")){
     if((tok=gettoken(ps, es, &q, &eq)) == 0)
       break;
     if(tok != 'a') {
       fprintf(stderr, "syntax error\n");
-      exit(-1);
-    }
-    cmd->argv[argc] = mkcopy(q, eq);
-    argc++;
-    if(argc >= MAXARGS) {
-      fprintf(stderr, "too many args\n");
-      exit(-1);
+      longjmp(parseerr, 1);
     }
+    addarg(cmd, q, eq);
     ret = parseredirs(ret, ps, es);
   }
-  cmd->argv[argc] = 0;
+  addarg(cmd, 0, 0);
+  cmd->argc--;  // the terminating 0 is not an argument
   return ret;
 }
\ No newline at end of file